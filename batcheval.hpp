@@ -0,0 +1,199 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define BATCH_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// =========================
+// 批次線性評估
+// =========================
+// 靜態評估對可調參數是線性的（只差殘局縮放挑哪一邊），所以每個局面可以先攤成一串
+// (參數編號, 係數)，係數已乘上 MG / EG 的階段權重。之後換一組參數重新評估整批局面
+// 只剩「查參數 × 係數」的累加：
+//   x = imbalance + Σ w[idx] * coef；分數 = x * (x > 0 ? scaleW : scaleB) / 64（白方視角）
+// 特化殘局（KXK、KBNK…）不是線性的，直接存分數。
+// 局面 8 個一組（AVX2 一個 lane 一個局面），組內項目數補到最長的那個，補的項目係數為 0。
+struct BatchTerm {
+    int16_t idx;
+    float coef;
+};
+
+struct BatchEntry {
+    std::vector<BatchTerm> terms;
+    float imbalance=0;
+    float scaleW=64, scaleB=64;
+    bool fixed=false;
+    float fixedScore=0;
+};
+
+struct EvalBatch {
+    static constexpr int LANES = 8;
+
+    // 每組：項目 k 的 8 個 lane 連續存放在 [ (offset+k)*8, (offset+k)*8 + 8 )
+    std::vector<int16_t> idx;
+    std::vector<float> coef;
+    std::vector<uint32_t> blockOffset;
+    std::vector<uint32_t> blockTerms;
+    // 每局面（長度補到 8 的倍數）
+    std::vector<float> imbalance, scaleW, scaleB, fixedScore;
+    std::vector<int32_t> fixedMask;   // -1 = 特化殘局（AVX2 blend 用）
+    size_t count=0;
+
+    size_t blocks() const{ return blockOffset.size(); }
+
+    void clear(){
+        *this = EvalBatch();
+    }
+
+    void push(const BatchEntry& e){
+        pending.push_back(e);
+        count++;
+        if(pending.size() == LANES) flush();
+    }
+
+    // 最後不滿 8 個的那組補空局面；全部 push 完呼叫一次
+    void finish(){
+        if(!pending.empty()) flush();
+    }
+
+    size_t bytes() const{
+        return idx.size()*sizeof(int16_t) + coef.size()*sizeof(float)
+             + imbalance.size()*(4*sizeof(float) + sizeof(int32_t));
+    }
+
+private:
+    std::vector<BatchEntry> pending;
+
+    void flush(){
+        size_t len = 0;
+        for(const BatchEntry& e : pending) len = std::max(len, e.terms.size());
+        blockOffset.push_back((uint32_t)(idx.size() / LANES));
+        blockTerms.push_back((uint32_t)len);
+        for(size_t k=0;k<len;k++){
+            for(int lane=0;lane<LANES;lane++){
+                const BatchEntry* e = lane < (int)pending.size() ? &pending[lane] : nullptr;
+                bool has = e && k < e->terms.size();
+                idx.push_back(has ? e->terms[k].idx : 0);
+                coef.push_back(has ? e->terms[k].coef : 0.0f);
+            }
+        }
+        for(int lane=0;lane<LANES;lane++){
+            BatchEntry empty;
+            const BatchEntry& e = lane < (int)pending.size() ? pending[lane] : empty;
+            imbalance.push_back(e.imbalance);
+            scaleW.push_back(e.scaleW);
+            scaleB.push_back(e.scaleB);
+            fixedScore.push_back(e.fixedScore);
+            fixedMask.push_back(e.fixed ? -1 : 0);
+        }
+        pending.clear();
+    }
+};
+
+// =========================
+// 核心：純量與 AVX2（gather + FMA），執行時依 CPU 選擇
+// =========================
+enum class BatchKernel { Auto, Scalar, Avx2 };
+
+inline bool cpuHasAvx2(){
+#if defined(BATCH_X86) && defined(_MSC_VER)
+    int r[4];
+    __cpuid(r, 0);
+    if(r[0] < 7) return false;
+    __cpuid(r, 1);
+    bool fma = (r[2] >> 12) & 1, osxsave = (r[2] >> 27) & 1;
+    if(!fma || !osxsave || (_xgetbv(0) & 6) != 6) return false;
+    __cpuidex(r, 7, 0);
+    return (r[1] >> 5) & 1;
+#elif defined(BATCH_X86) && defined(__GNUC__)
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+    return false;
+#endif
+}
+
+inline BatchKernel resolveKernel(BatchKernel k){
+    static const bool avx2 = cpuHasAvx2();
+    if(k == BatchKernel::Auto) return avx2 ? BatchKernel::Avx2 : BatchKernel::Scalar;
+    if(k == BatchKernel::Avx2 && !avx2) return BatchKernel::Scalar;
+    return k;
+}
+
+inline const char* kernelName(BatchKernel k){
+    return resolveKernel(k) == BatchKernel::Avx2 ? "avx2" : "scalar";
+}
+
+// 組 [b0, b1) 的分數寫到 out[b*8 .. b*8+8)（out 長度至少 blocks()*8）
+inline void evalBatchScalar(const EvalBatch& B, const float* w, float* out, size_t b0, size_t b1){
+    for(size_t b=b0;b<b1;b++){
+        float acc[EvalBatch::LANES] = {};
+        const size_t base = (size_t)B.blockOffset[b] * EvalBatch::LANES;
+        for(uint32_t k=0;k<B.blockTerms[b];k++){
+            const int16_t* ix = &B.idx[base + (size_t)k*EvalBatch::LANES];
+            const float* cf = &B.coef[base + (size_t)k*EvalBatch::LANES];
+            for(int lane=0;lane<EvalBatch::LANES;lane++) acc[lane] += w[ix[lane]] * cf[lane];
+        }
+        for(int lane=0;lane<EvalBatch::LANES;lane++){
+            size_t i = b*EvalBatch::LANES + lane;
+            float x = B.imbalance[i] + acc[lane];
+            out[i] = B.fixedMask[i] ? B.fixedScore[i] : x * (x > 0 ? B.scaleW[i] : B.scaleB[i]) * (1.0f/64);
+        }
+    }
+}
+
+#if defined(BATCH_X86)
+#if defined(__GNUC__) || defined(__clang__)
+#define BATCH_AVX2_TARGET __attribute__((target("avx2,fma")))
+#else
+#define BATCH_AVX2_TARGET
+#endif
+
+BATCH_AVX2_TARGET
+inline void evalBatchAvx2(const EvalBatch& B, const float* w, float* out, size_t b0, size_t b1){
+    const __m256 zero = _mm256_setzero_ps(), inv64 = _mm256_set1_ps(1.0f/64);
+    for(size_t b=b0;b<b1;b++){
+        __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+        const size_t base = (size_t)B.blockOffset[b] * EvalBatch::LANES;
+        const int16_t* ix = &B.idx[base];
+        const float* cf = &B.coef[base];
+        uint32_t n = B.blockTerms[b], k = 0;
+        // 兩條累加鏈交錯，蓋掉 gather 的延遲
+        for(; k+1<n; k+=2, ix+=16, cf+=16){
+            __m256i i0 = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ix)));
+            __m256i i1 = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ix+8)));
+            acc0 = _mm256_fmadd_ps(_mm256_i32gather_ps(w, i0, 4), _mm256_loadu_ps(cf), acc0);
+            acc1 = _mm256_fmadd_ps(_mm256_i32gather_ps(w, i1, 4), _mm256_loadu_ps(cf+8), acc1);
+        }
+        if(k<n){
+            __m256i i0 = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ix)));
+            acc0 = _mm256_fmadd_ps(_mm256_i32gather_ps(w, i0, 4), _mm256_loadu_ps(cf), acc0);
+        }
+        const size_t i = b*EvalBatch::LANES;
+        __m256 x = _mm256_add_ps(_mm256_loadu_ps(&B.imbalance[i]), _mm256_add_ps(acc0, acc1));
+        __m256 scale = _mm256_blendv_ps(_mm256_loadu_ps(&B.scaleB[i]), _mm256_loadu_ps(&B.scaleW[i]),
+                                        _mm256_cmp_ps(x, zero, _CMP_GT_OQ));
+        __m256 sc = _mm256_mul_ps(_mm256_mul_ps(x, scale), inv64);
+        __m256 fixedMask = _mm256_castsi256_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(&B.fixedMask[i])));
+        _mm256_storeu_ps(&out[i], _mm256_blendv_ps(sc, _mm256_loadu_ps(&B.fixedScore[i]), fixedMask));
+    }
+}
+#endif
+
+inline void evalBatch(const EvalBatch& B, const float* w, float* out, size_t b0, size_t b1,
+                      BatchKernel k = BatchKernel::Auto){
+#if defined(BATCH_X86)
+    if(resolveKernel(k) == BatchKernel::Avx2){
+        evalBatchAvx2(B, w, out, b0, b1);
+        return;
+    }
+#endif
+    (void)k;
+    evalBatchScalar(B, w, out, b0, b1);
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <cstdint>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// =========================
+// Bitboard 基本工具（a1 = bit 0，h8 = bit 63）
+// =========================
+constexpr uint64_t FILE_A_BB = 0x0101010101010101ULL;
+constexpr uint64_t FILE_H_BB = FILE_A_BB << 7;
+
+inline uint64_t fileBB(int f){ return FILE_A_BB << f; }
+inline uint64_t adjacentFilesBB(int f){
+    return (f>0 ? fileBB(f-1) : 0) | (f<7 ? fileBB(f+1) : 0);
+}
+// sq 前方（白往 rank 8、黑往 rank 1）的所有 rank，不含 sq 本身那一排
+inline uint64_t forwardRanksBB(bool white, int sq){
+    int r = sq >> 3;
+    if(white) return r==7 ? 0 : ~0ULL << (8*(r+1));
+    return r==0 ? 0 : ~0ULL >> (8*(8-r));
+}
+inline uint64_t pawnAttacksBB(bool white, uint64_t pawns){
+    return white ? ((pawns & ~FILE_A_BB) << 7) | ((pawns & ~FILE_H_BB) << 9)
+                 : ((pawns & ~FILE_A_BB) >> 9) | ((pawns & ~FILE_H_BB) >> 7);
+}
+
+#if defined(_MSC_VER)
+inline int popcount(uint64_t b){ return (int)__popcnt64(b); }
+inline int lsb(uint64_t b){ unsigned long i; _BitScanForward64(&i, b); return (int)i; }
+inline int msb(uint64_t b){ unsigned long i; _BitScanReverse64(&i, b); return (int)i; }
+#else
+inline int popcount(uint64_t b){ return __builtin_popcountll(b); }
+inline int lsb(uint64_t b){ return __builtin_ctzll(b); }
+inline int msb(uint64_t b){ return 63 ^ __builtin_clzll(b); }
+#endif
+
+// 取出並清掉最低位的 1（b 不可為 0）
+inline int popLsb(uint64_t& b){
+    int sq = lsb(b);
+    b &= b - 1;
+    return sq;
+}
+
+// =========================
+// 攻擊表
+// =========================
+// 騎士 / 王查表；滑子用射線表：沿方向找第一個阻擋子，把它後面那段射線扣掉（classical approach）
+enum RayDir : int { RAY_N, RAY_NE, RAY_E, RAY_SE, RAY_S, RAY_SW, RAY_W, RAY_NW };
+
+struct AttackTables {
+    uint64_t knight[64]{};
+    uint64_t king[64]{};
+    uint64_t ray[8][64]{};
+
+    AttackTables(){
+        static const int df[8] = {0, 1, 1, 1, 0,-1,-1,-1};
+        static const int dr[8] = {1, 1, 0,-1,-1,-1, 0, 1};
+        static const int nf[8] = {1, 2, 2, 1,-1,-2,-2,-1};
+        static const int nr[8] = {2, 1,-1,-2,-2,-1, 1, 2};
+        for(int sq=0;sq<64;sq++){
+            int f = sq & 7, r = sq >> 3;
+            for(int d=0;d<8;d++){
+                if(f+nf[d]>=0 && f+nf[d]<8 && r+nr[d]>=0 && r+nr[d]<8) knight[sq] |= 1ULL << ((r+nr[d])*8 + f+nf[d]);
+                if(f+df[d]>=0 && f+df[d]<8 && r+dr[d]>=0 && r+dr[d]<8) king[sq] |= 1ULL << ((r+dr[d])*8 + f+df[d]);
+                for(int x=f+df[d], y=r+dr[d]; x>=0 && x<8 && y>=0 && y<8; x+=df[d], y+=dr[d])
+                    ray[d][sq] |= 1ULL << (y*8 + x);
+            }
+        }
+    }
+};
+inline const AttackTables ATTACKS;
+
+// N / NE / E / NW 往 bit 變大的方向走，第一個阻擋子是 lsb；其餘是 msb
+inline uint64_t rayAttacks(int dir, int sq, uint64_t occ){
+    uint64_t ray = ATTACKS.ray[dir][sq];
+    uint64_t blockers = ray & occ;
+    if(!blockers) return ray;
+    bool up = dir==RAY_N || dir==RAY_NE || dir==RAY_E || dir==RAY_NW;
+    return ray ^ ATTACKS.ray[dir][up ? lsb(blockers) : msb(blockers)];
+}
+
+inline uint64_t bishopAttacks(int sq, uint64_t occ){
+    return rayAttacks(RAY_NE, sq, occ) | rayAttacks(RAY_SE, sq, occ)
+         | rayAttacks(RAY_SW, sq, occ) | rayAttacks(RAY_NW, sq, occ);
+}
+inline uint64_t rookAttacks(int sq, uint64_t occ){
+    return rayAttacks(RAY_N, sq, occ) | rayAttacks(RAY_E, sq, occ)
+         | rayAttacks(RAY_S, sq, occ) | rayAttacks(RAY_W, sq, occ);
+}
@@ -0,0 +1,288 @@
+#pragma once
+#include "engine_real.hpp"
+#include <chrono>
+
+// =========================
+// df-pn 殺棋求解（depth-first proof-number search）
+// =========================
+// 攻方（根節點走子方）要在 maxPly 內將死對方；攻方走的是 OR 節點、守方走的是 AND 節點。
+// 以走子方視角的 phi / delta 寫成 negamax：phi(n) = min delta(c)，delta(n) = Σ phi(c)，
+// 只展開 (phi, delta) 都還在門檻內的最有希望子節點，門檻用第二好的兄弟決定。
+// 置換表和 alpha-beta 的 TT 分開、有自己的記憶體上限：
+//   攻方的證明存將死距離（剩餘 ply 夠就沿用），守方的反證存當時的剩餘 ply（剩餘更少時才沿用）。
+struct DfpnEntry {
+    uint64_t key=0;
+    uint32_t phi=0, delta=0;
+    uint32_t work=0;      // 這個子樹花掉的節點數，換表時留大的
+    int16_t rem=0;        // 存入時的剩餘 ply
+    int16_t dist=0;       // 攻方已證明時：將死距離（ply）
+    uint16_t move=0;      // packMove
+};
+
+struct DfpnTable {
+    static constexpr int BUCKET = 4;
+
+    std::vector<DfpnEntry> table;
+    uint64_t mask=0;
+    size_t used=0;
+
+    // 以 MB 為單位，取不超過的 2 的冪個 bucket
+    void resize(size_t mb){
+        size_t n = 1;
+        while(n * 2 * BUCKET * sizeof(DfpnEntry) <= mb * 1024 * 1024) n *= 2;
+        table.assign(n * BUCKET, DfpnEntry{});
+        mask = n - 1;
+        used = 0;
+    }
+
+    void clear(){
+        std::fill(table.begin(), table.end(), DfpnEntry{});
+        used = 0;
+    }
+
+    const DfpnEntry* probe(uint64_t key) const{
+        const DfpnEntry* b = &table[(key & mask) * BUCKET];
+        for(int i=0;i<BUCKET;i++) if(b[i].key == key && b[i].work) return &b[i];
+        return nullptr;
+    }
+
+    // 同局面就地更新，否則換掉 bucket 裡 work 最小的一格
+    void store(const DfpnEntry& e){
+        DfpnEntry* b = &table[(e.key & mask) * BUCKET];
+        DfpnEntry* victim = &b[0];
+        for(int i=0;i<BUCKET;i++){
+            if(b[i].key == e.key || !b[i].work){ victim = &b[i]; break; }
+            if(b[i].work < victim->work) victim = &b[i];
+        }
+        if(!victim->work) used++;
+        *victim = e;
+    }
+
+    int permille() const{
+        return (int)(used * 1000 / std::max<size_t>(table.size(), 1));
+    }
+};
+
+struct DfpnResult {
+    enum Status { Proven, Disproven, Unknown };
+    Status status=Unknown;
+    int matePlies=0;             // 將死距離（ply）；solver.shortest 關掉時不一定是最短殺
+    std::vector<Move> pv;
+    uint64_t nodes=0;
+    double seconds=0;
+    int hashfull=0;
+};
+
+class DfpnSolver {
+public:
+    static constexpr uint32_t INF = 1u << 30;
+
+    size_t hashMB=64;
+    uint64_t nodeLimit=0;        // 0 = 不限
+    int64_t timeLimitMs=0;       // 0 = 不限
+    SearchControl* control=nullptr;
+    bool shortest=true;          // 證明後再用更少的 ply 重證，直到證不出來，得到最短殺
+
+    // 在 mateMoves 步（攻方的步數）內找殺；表每次重新清空
+    DfpnResult solve(const Position& root, int mateMoves){
+        if(tt.table.empty() || ttMB != hashMB){
+            tt.resize(hashMB);
+            ttMB = hashMB;
+        }else tt.clear();
+        nodes = 0;
+        aborted = false;
+        t0 = std::chrono::steady_clock::now();
+        attackerWhite = root.whiteToMove;
+
+        Position pos = root;
+        pos.nnue = nullptr;
+        pos.setPsqTable(nullptr);
+        int maxPly = std::max(1, std::min(2*mateMoves - 1, MAX_PLY - 1));
+        Value v = mid(pos, INF-1, INF-1, maxPly, 0);
+        // 表裡的證明 / 反證依剩餘 ply 判斷能否沿用，所以重證時不清表
+        while(shortest && v.phi == 0 && v.dist > 1 && !aborted){
+            Value w = mid(pos, INF-1, INF-1, v.dist - 2, 0);
+            if(w.phi != 0){
+                // 失敗那輪的反證蓋掉了同局面的證明，重證一次讓 PV 走得出來
+                if(!aborted) mid(pos, INF-1, INF-1, v.dist, 0);
+                break;
+            }
+            v = w;
+        }
+        if(v.phi == 0) maxPly = v.dist;
+
+        DfpnResult r;
+        r.nodes = nodes;
+        r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        r.hashfull = tt.permille();
+        if(v.phi == 0){
+            r.status = DfpnResult::Proven;
+            r.matePlies = v.dist;
+            extractPV(pos, maxPly, r.pv);
+        }else if(v.delta == 0) r.status = DfpnResult::Disproven;
+        return r;
+    }
+
+private:
+    struct Value {
+        uint32_t phi=1, delta=1;
+        int dist=0;
+    };
+
+    DfpnTable tt;
+    size_t ttMB=0;
+    uint64_t nodes=0;
+    bool aborted=false;
+    bool attackerWhite=true;
+    std::chrono::steady_clock::time_point t0;
+    // 每層的著法與子節點目前的值（遞迴中不配置）
+    std::vector<MoveList> moveStack = std::vector<MoveList>(MAX_PLY+1);
+    std::vector<std::array<Value, MAX_MOVES>> childStack = std::vector<std::array<Value, MAX_MOVES>>(MAX_PLY+1);
+
+    static uint32_t satAdd(uint32_t a, uint32_t b){ return std::min<uint64_t>((uint64_t)a + b, INF); }
+
+    bool orNode(const Position& pos) const{ return pos.whiteToMove == attackerWhite; }
+
+    // 依剩餘 ply 判斷表裡的結果能不能用；不能用就當作新節點 (1, 1)
+    Value lookup(const Position& pos, int rem) const{
+        Value v;
+        const DfpnEntry* e = tt.probe(pos.key);
+        if(!e) return v;
+        bool isOr = orNode(pos);
+        bool proof = isOr ? e->phi == 0 : e->delta == 0;
+        bool disproof = isOr ? e->delta == 0 : e->phi == 0;
+        if((proof && rem >= e->dist) || (disproof && rem <= e->rem) || (!proof && !disproof && rem == e->rem)){
+            v.phi = e->phi;
+            v.delta = e->delta;
+            v.dist = e->dist;
+        }
+        return v;
+    }
+
+    void store(const Position& pos, const Value& v, int rem, uint64_t work, uint16_t move){
+        DfpnEntry e;
+        e.key = pos.key;
+        e.phi = v.phi;
+        e.delta = v.delta;
+        e.work = (uint32_t)std::min<uint64_t>(std::max<uint64_t>(work, 1), 0xFFFFFFFFu);
+        e.rem = (int16_t)rem;
+        e.dist = (int16_t)v.dist;
+        e.move = move;
+        tt.store(e);
+    }
+
+    void poll(){
+        if(nodeLimit && nodes >= nodeLimit) aborted = true;
+        if(nodes & (TimeManager::TIME_CHECK_NODES-1)) return;
+        if(control && control->stop) aborted = true;
+        if(timeLimitMs > 0 && std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count() >= (double)timeLimitMs)
+            aborted = true;
+    }
+
+    // 走子方「達成目標」：攻方已將死 / 守方已逃脫
+    static Value won(int dist=0){ Value v; v.phi = 0; v.delta = INF; v.dist = dist; return v; }
+    static Value lost(int dist=0){ Value v; v.phi = INF; v.delta = 0; v.dist = dist; return v; }
+
+    Value mid(Position& pos, uint32_t thPhi, uint32_t thDelta, int rem, int ply){
+        nodes++;
+        poll();
+        const uint64_t startNodes = nodes;
+        const bool isOr = orNode(pos);
+
+        MoveList& moves = moveStack[ply];
+        pos.genLegalMoves(moves);
+        Value v;
+        if(moves.empty()){
+            // 攻方沒著可走（被殺或逼和）= 失敗；守方被將死 = 攻方證明，逼和 = 守方逃脫
+            v = isOr ? lost() : pos.isInCheck(pos.whiteToMove) ? lost(0) : won();
+            store(pos, v, rem, 1, 0);
+            return v;
+        }
+        if(rem == 0 || ply >= MAX_PLY){
+            // 攻方沒步數了；守方還有著可走就算逃掉
+            v = isOr ? lost() : won();
+            store(pos, v, rem, 1, 0);
+            return v;
+        }
+
+        Value* child = childStack[ply].data();
+        const size_t n = moves.size();
+        for(size_t i=0;i<n;i++){
+            Undo u;
+            pos.makeMove(moves[i], u);
+            child[i] = lookup(pos, rem-1);
+            pos.unmakeMove(moves[i], u);
+        }
+
+        size_t best = 0;
+        while(true){
+            // phi = min delta(c)，delta = Σ phi(c)；同時找最好與第二好的 delta
+            uint32_t phi = INF, delta = 0, delta2 = INF;
+            best = 0;
+            for(size_t i=0;i<n;i++){
+                delta = satAdd(delta, child[i].phi);
+                if(child[i].delta < phi){
+                    delta2 = phi;
+                    phi = child[i].delta;
+                    best = i;
+                }else if(child[i].delta < delta2) delta2 = child[i].delta;
+            }
+            v.phi = phi;
+            v.delta = delta;
+            if(phi >= thPhi || delta >= thDelta || aborted) break;
+
+            uint32_t childThPhi = thDelta - (delta - child[best].phi);   // delta < thDelta，不會變負
+            uint32_t childThDelta = std::min(thPhi, satAdd(delta2, delta2 / 4 + 1));   // 1+ε 門檻，少來回切換兄弟
+            Undo u;
+            pos.makeMove(moves[best], u);
+            child[best] = mid(pos, childThPhi, childThDelta, rem-1, ply+1);
+            pos.unmakeMove(moves[best], u);
+        }
+
+        // 將死距離：攻方證明時取最短的那條；守方全部被證明時取最長的那條
+        v.dist = 0;
+        if(isOr && v.phi == 0){
+            v.dist = INT16_MAX;
+            for(size_t i=0;i<n;i++){
+                if(child[i].delta == 0 && child[i].dist + 1 < v.dist){
+                    v.dist = child[i].dist + 1;
+                    best = i;
+                }
+            }
+        }
+        if(!isOr && v.delta == 0){
+            for(size_t i=0;i<n;i++) v.dist = std::max(v.dist, child[i].dist + 1);
+        }
+        if(!aborted || v.phi == 0 || v.delta == 0)
+            store(pos, v, rem, nodes - startNodes + 1, packMove(moves[best]));
+        return v;
+    }
+
+    // 沿表走證明樹：攻方挑距離最短的殺著，守方挑撐最久的應著
+    void extractPV(Position& pos, int rem, std::vector<Move>& pv){
+        for(int ply=0; ply<MAX_PLY && rem>0; ply++, rem--){
+            MoveList moves;
+            pos.genLegalMoves(moves);
+            if(moves.empty()) return;
+            bool isOr = orNode(pos);
+            int bestDist = isOr ? INT32_MAX : -1;
+            size_t pick = moves.size();
+            for(size_t i=0;i<moves.size();i++){
+                Undo u;
+                pos.makeMove(moves[i], u);
+                Value c = lookup(pos, rem-1);
+                pos.unmakeMove(moves[i], u);
+                bool proven = isOr ? c.delta == 0 : c.phi == 0;
+                if(!proven) continue;
+                if(isOr ? c.dist < bestDist : c.dist > bestDist){
+                    bestDist = c.dist;
+                    pick = i;
+                }
+            }
+            if(pick == moves.size()) return;
+            Undo u;
+            pv.push_back(moves[pick]);
+            pos.makeMove(moves[pick], u);
+        }
+    }
+};
@@ -0,0 +1,78 @@
+#include "engine_real.hpp"
+#include <cstdio>
+
+// ============================
+// embed_weights：把權重檔轉成 constexpr 表（CMake 選項 CHESS_EMBED_WEIGHTS 在建置時呼叫）
+// ============================
+// 用法：embed_weights <weights 檔> <輸出 .hpp>
+// 讀檔走 Weights::load（舊格式與具名格式都吃），輸出 engine_real.hpp 期待的三個名稱：
+//   EMBEDDED_WEIGHTS_FILE、EMBEDDED_WEIGHT_PARAMS（forEachParam 順序）、EMBEDDED_EVAL（compile 後的兵型參數與機動力表）
+static void writeDoubles(std::FILE* f, const double* v, int n) {
+    for (int i = 0; i < n; i++) std::fprintf(f, "%s%.17g", i ? "," : "", v[i]);
+}
+
+static void writeShorts(std::FILE* f, const int16_t* v, int n) {
+    for (int i = 0; i < n; i++) std::fprintf(f, "%s%d", i ? "," : "", v[i]);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::fprintf(stderr, "usage: embed_weights <weights file> <output header>\n");
+        return 2;
+    }
+    Weights w = Weights::defaultWeights();
+    if (!w.load(argv[1])) {
+        std::fprintf(stderr, "[ERR] cannot load weights from %s\n", argv[1]);
+        return 1;
+    }
+
+    std::vector<double> params;
+    w.forEachParam([&](const char*, double* v, int count, const ParamBounds&) {
+        params.insert(params.end(), v, v + count);
+    });
+
+    std::FILE* f = std::fopen(argv[2], "w");
+    if (!f) {
+        std::fprintf(stderr, "[ERR] cannot write %s\n", argv[2]);
+        return 1;
+    }
+    std::string src = argv[1];
+    std::string escaped;
+    for (char ch : src) {
+        if (ch == '\\' || ch == '"') escaped += '\\';
+        escaped += ch;
+    }
+
+    std::fprintf(f, "#pragma once\n");
+    std::fprintf(f, "// embed_weights 由 %s 產生，不要手改\n", argv[1]);
+    std::fprintf(f, "constexpr const char* EMBEDDED_WEIGHTS_FILE = \"%s\";\n\n", escaped.c_str());
+
+    std::fprintf(f, "constexpr double EMBEDDED_WEIGHT_PARAMS[%zu] = {\n", params.size());
+    for (size_t i = 0; i < params.size(); i += 8) {
+        std::fprintf(f, "    ");
+        writeDoubles(f, &params[i], (int)std::min<size_t>(8, params.size() - i));
+        std::fprintf(f, ",\n");
+    }
+    std::fprintf(f, "};\n\n");
+
+    std::fprintf(f, "constexpr EvalConstants EMBEDDED_EVAL = {\n    {");
+    writeDoubles(f, w.passedPawn, 8);
+    std::fprintf(f, "},\n    %.17g, %.17g, %.17g,\n    {{", w.isolatedPawn, w.doubledPawn, w.backwardPawn);
+    for (int ph = 0; ph < 2; ph++) {
+        std::fprintf(f, "%s{", ph ? ",\n      " : "");
+        for (int pt = 0; pt < 4; pt++) {
+            std::fprintf(f, "%s{", pt ? ",\n       " : "");
+            writeShorts(f, w.activity.mobility[ph][pt], MOBILITY_MAX);
+            std::fprintf(f, "}");
+        }
+        std::fprintf(f, "}");
+    }
+    std::fprintf(f, "},\n     {");
+    writeShorts(f, w.activity.kingAttack, 4);
+    std::fprintf(f, "}}\n};\n");
+
+    bool ok = std::fclose(f) == 0;
+    if (!ok) std::fprintf(stderr, "[ERR] cannot write %s\n", argv[2]);
+    else std::printf("embedded %zu weights from %s\n", params.size(), argv[1]);
+    return ok ? 0 : 1;
+}
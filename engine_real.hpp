@@ -1,5 +1,6 @@
 #pragma once
 #include <array>
+#include <initializer_list>
 #include <vector>
 #include <string>
 #include <random>
@@ -8,6 +9,18 @@
 #include <fstream>
 #include <sstream>
 #include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <memory>
+#include "timeman.hpp"
+#include "tt.hpp"
+#include "bitboard.hpp"
+#include "nnue.hpp"
+#include "batcheval.hpp"
+#include "tablebase.hpp"
 
 enum Piece : int {
     EMPTY = 0,
@@ -17,12 +30,60 @@ enum Piece : int {
 inline bool isWhite(Piece p){ return p>=WP && p<=WK; }
 inline bool isBlack(Piece p){ return p>=BP && p<=BK; }
 
+// =========================
+// Zobrist keys（固定種子，跨執行 / 跨執行緒都一致）
+// =========================
+struct ZobristKeys {
+    uint64_t piece[13][64]{};
+    uint64_t castle[16]{};
+    uint64_t epFile[8]{};
+    uint64_t side=0;
+    uint64_t noPawns=0;   // pawn key 的起始值：沒有兵的局面也不會是 0（0 = 空的 pawn hash 格）
+
+    ZobristKeys(){
+        uint64_t s = 0x9E3779B97F4A7C15ULL;
+        auto next = [&]{   // splitmix64
+            uint64_t z = (s += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            return z ^ (z >> 31);
+        };
+        for(int p=1;p<13;p++) for(int sq=0;sq<64;sq++) piece[p][sq]=next();
+        for(auto& k : castle) k=next();
+        for(auto& k : epFile) k=next();
+        side=next();
+        noPawns=next();
+    }
+};
+inline const ZobristKeys ZOBRIST;
+
 struct Move {
     int from=0, to=0;
     Piece promo=EMPTY;
     Piece captured=EMPTY;
 };
 
+// 固定容量的著法清單：搜尋中不做任何配置（任何局面的合法著都遠少於 256）
+constexpr int MAX_MOVES = 256;
+
+struct MoveList {
+    Move moves[MAX_MOVES];
+    size_t n=0;
+
+    void clear(){ n=0; }
+    void push_back(const Move& m){ moves[n++]=m; }
+    void reserve(size_t){}
+    void resize(size_t k){ n=k; }
+    size_t size() const{ return n; }
+    bool empty() const{ return n==0; }
+    Move& operator[](size_t i){ return moves[i]; }
+    const Move& operator[](size_t i) const{ return moves[i]; }
+    Move* begin(){ return moves; }
+    Move* end(){ return moves+n; }
+    const Move* begin() const{ return moves; }
+    const Move* end() const{ return moves+n; }
+};
+
 struct Undo {
     Piece captured=EMPTY;
     int halfmoveClock=0;
@@ -38,32 +99,226 @@ struct Undo {
     Piece rookPiece=EMPTY;
 
     Piece movedPiece=EMPTY; // 起點那顆（升變前）
+    uint64_t key=0;         // 走之前的 Zobrist key
+    uint64_t pawnKey=0;
+    uint64_t materialKey=0;
+    int psqScore[2][2]{};
+};
+
+// =========================
+// 子力 + PST 表（由 Weights 編譯）
+// =========================
+// psq[MG/EG][棋子-1][格]：子力已併入、黑子已鏡像，每顆子以自己顏色為正。
+// int16 + 64-byte 對齊：一個 phase 1.5 KB，整張表放得進 L1。
+enum GamePhase : int { MG = 0, EG = 1 };
+
+// 遊戲階段：輕子 1、車 2、后 4，開局滿子 = 24；評估在 MG 與 EG 之間依此線性內插
+constexpr int PHASE_MAX = 24;
+constexpr int PHASE_INC[13] = {0, 0,1,1,2,4,0, 0,1,1,2,4,0};
+
+struct PsqTable {
+    alignas(64) int16_t psq[2][12][64]{};
+
+    int16_t at(int phase, Piece pc, int sq) const{ return psq[phase][pc-1][sq]; }
+};
+
+// 機動力與王區攻擊（N,B,R,Q）編譯成的查表：mobility[MG/EG][種類][安全格數]，kingAttack 為每格的 MG 分數。
+// 機動力以 MOBILITY_BASE 為 0 分，少於基準為負，避免整體平移跟子力值搶分。
+constexpr int MOBILITY_BASE[4] = {4, 6, 7, 13};
+constexpr int MOBILITY_MAX = 28;   // 后最多 27 格
+
+struct ActivityTable {
+    int16_t mobility[2][4][MOBILITY_MAX]{};
+    int16_t kingAttack[4]{};
+};
+
+// 搜尋中評估實際讀到的 Weights 欄位（兵型參數與機動力查表），欄位名稱和 Weights 相同，
+// evalPawns / evalClassical 兩種都吃。編進執行檔的權重就是一個 constexpr 的 EvalConstants。
+struct EvalConstants {
+    double passedPawn[8];
+    double isolatedPawn, doubledPawn, backwardPawn;
+    ActivityTable activity;
+};
+
+// CMake 選項 CHESS_EMBED_WEIGHTS：embed_weights 在建置時把權重檔轉成 embedded_weights.hpp，
+// 提供 EMBEDDED_WEIGHTS_FILE、EMBEDDED_WEIGHT_PARAMS（forEachParam 順序）與 EMBEDDED_EVAL
+#ifdef CHESS_EMBEDDED_WEIGHTS
+#include "embedded_weights.hpp"
+#endif
+
+// weights 檔：第 2 版起每行「名稱 值…」並有版本行；沒有版本行的是舊的純數字格式
+constexpr int WEIGHTS_VERSION = 2;
+
+// 參數的夾限範圍（SPSA / Texel）：整組共用一個範圍，或每個元素各一個（lo / hi 指向 count 個值）
+struct ParamBounds {
+    double lo0=0, hi0=0;
+    const double* los=nullptr;
+    const double* his=nullptr;
+
+    ParamBounds(double l, double h): lo0(l), hi0(h){}
+    ParamBounds(const double* l, const double* h): los(l), his(h){}
+
+    double lo(int i) const{ return los ? los[i] : lo0; }
+    double hi(int i) const{ return his ? his[i] : hi0; }
 };
 
 struct Weights {
-    double material[6]{100,320,330,500,900,0}; // P,N,B,R,Q,K
-    double pstPawn[64]{0};
-    double pstKnight[64]{0};
+    double material[6]{100,320,330,500,900,0};     // P,N,B,R,Q,K（MG）
+    double materialEg[6]{100,320,330,500,900,0};
+    double pst[2][6][64]{};                        // [MG/EG][P..K][格]，白方視角
+
+    // 兵型（pawn hash 快取）：通路兵依相對 rank 加分，其餘為每個兵的扣分
+    double passedPawn[8]{0,5,10,20,35,60,100,0};
+    double isolatedPawn=10;
+    double doubledPawn=12;
+    double backwardPawn=8;
+
+    // 機動力（每個安全格）與王區攻擊（每個被攻擊的王區格）：N,B,R,Q
+    double mobility[2][4]{{4,5,2,1},{4,5,4,2}};
+    double kingAttack[4]{6,4,5,8};
+
+    // 上面的參數編譯成的查表；改過參數之後要 compile()（load 與 trainer 的 unflatten 會自動做）
+    PsqTable psqt;
+    ActivityTable activity;
+
+    // 參數就是編進執行檔的那組（builtin() 設定，load 清掉）：搜尋可改用 constexpr 的 EMBEDDED_EVAL
+    bool embedded=false;
+
+#ifdef CHESS_EMBEDDED_WEIGHTS
+    static constexpr bool HAS_EMBEDDED = true;
+#else
+    static constexpr bool HAS_EMBEDDED = false;
+#endif
+
+    Weights(){ compile(); }
 
     static Weights defaultWeights(){ return Weights(); }
 
+    // 編進執行檔的權重；沒有編進去就是預設值
+    static Weights builtin(){
+        Weights w;
+#ifdef CHESS_EMBEDDED_WEIGHTS
+        w.setParams(EMBEDDED_WEIGHT_PARAMS);
+        w.compile();
+        w.embedded = true;
+#endif
+        return w;
+    }
+
+    // v 依 forEachParam 的順序攤平；之後要 compile()
+    void setParams(const double* v){
+        size_t k = 0;
+        forEachParam([&](const char*, double* p, int count, const ParamBounds&){
+            for(int i=0;i<count;i++) p[i] = v[k++];
+        });
+    }
+
+    // 所有可調參數：名稱、位置、個數、夾限範圍。存讀檔與 trainer 的 ParamView / Texel 都照這張表走，
+    // 新增參數只要在這裡加一行。
+    template<class F>
+    void forEachParam(F&& f){
+        static const char* const PST_NAMES[2][6] = {
+            {"pst_mg_pawn","pst_mg_knight","pst_mg_bishop","pst_mg_rook","pst_mg_queen","pst_mg_king"},
+            {"pst_eg_pawn","pst_eg_knight","pst_eg_bishop","pst_eg_rook","pst_eg_queen","pst_eg_king"}};
+        // 子力每種棋子各自的範圍（MG / EG 相同），王不計子力；通路兵在 rank 1/8 不會出現，固定為 0
+        static constexpr double MATERIAL_LO[6] = {60, 200, 200, 300, 600, 0};
+        static constexpr double MATERIAL_HI[6] = {200, 500, 500, 800, 1500, 0};
+        static constexpr double PASSED_LO[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+        static constexpr double PASSED_HI[8] = {0, 200, 200, 200, 200, 200, 200, 0};
+        f("material_mg", material, 6, ParamBounds(MATERIAL_LO, MATERIAL_HI));
+        f("material_eg", materialEg, 6, ParamBounds(MATERIAL_LO, MATERIAL_HI));
+        for(int ph=0;ph<2;ph++)
+            for(int id=0;id<6;id++)
+                f(PST_NAMES[ph][id], pst[ph][id], 64, ParamBounds(id==0 ? -80.0 : -120.0, 120.0));
+        f("passed_pawn", passedPawn, 8, ParamBounds(PASSED_LO, PASSED_HI));
+        f("isolated_pawn", &isolatedPawn, 1, ParamBounds(0.0, 60.0));
+        f("doubled_pawn", &doubledPawn, 1, ParamBounds(0.0, 60.0));
+        f("backward_pawn", &backwardPawn, 1, ParamBounds(0.0, 60.0));
+        f("mobility_mg", mobility[MG], 4, ParamBounds(0.0, 20.0));
+        f("mobility_eg", mobility[EG], 4, ParamBounds(0.0, 20.0));
+        f("king_zone_attack", kingAttack, 4, ParamBounds(0.0, 40.0));
+    }
+
+    void compile(){
+        const double* mat[2] = {material, materialEg};
+        for(int ph=0;ph<2;ph++){
+            for(int pc=WP;pc<=BK;pc++){
+                int id = (pc-1) % 6;
+                for(int sq=0;sq<64;sq++){
+                    int rel = pc<=WK ? sq : 63-sq;   // 黑方鏡像
+                    psqt.psq[ph][pc-1][sq] = (int16_t)std::llround(mat[ph][id] + pst[ph][id][rel]);
+                }
+            }
+            for(int pt=0;pt<4;pt++)
+                for(int n=0;n<MOBILITY_MAX;n++)
+                    activity.mobility[ph][pt][n] = (int16_t)std::llround(mobility[ph][pt] * (n - MOBILITY_BASE[pt]));
+        }
+        for(int pt=0;pt<4;pt++) activity.kingAttack[pt] = (int16_t)std::llround(kingAttack[pt]);
+    }
+
     bool load(const std::string& path){
         std::ifstream in(path);
         if(!in) return false;
+        std::stringstream buf;
+        buf << in.rdbuf();
+        std::string text = buf.str();
+
+        std::istringstream ss(text);
+        std::string first;
+        while(ss >> first && first[0]=='#') std::getline(ss, first);
+        bool ok = first=="version" ? loadNamed(text) : loadLegacy(text);
+        embedded = false;
+        compile();
+        return ok;
+    }
+
+    // 舊格式：material / pstPawn / pstKnight 三行（第 1 版多一行兵型參數）；只有一組 PST，EG 照抄 MG
+    bool loadLegacy(const std::string& text){
+        std::istringstream in(text);
         for(int i=0;i<6;i++) in>>material[i];
-        for(int i=0;i<64;i++) in>>pstPawn[i];
-        for(int i=0;i<64;i++) in>>pstKnight[i];
+        for(int i=0;i<64;i++) in>>pst[MG][0][i];
+        for(int i=0;i<64;i++) in>>pst[MG][1][i];
+        if(!in) return false;
+
+        double pawn[8+3];
+        for(double& v : pawn) in>>v;
+        if(in){
+            std::copy(pawn, pawn+8, passedPawn);
+            isolatedPawn = pawn[8];
+            doubledPawn  = pawn[9];
+            backwardPawn = pawn[10];
+        }
+        std::copy(material, material+6, materialEg);
+        std::copy(&pst[MG][0][0], &pst[MG][0][0]+6*64, &pst[EG][0][0]);
+        return true;
+    }
+
+    // 具名格式：不認得的名稱略過（較新版本的檔），檔裡沒有的參數保留預設
+    bool loadNamed(const std::string& text){
+        std::istringstream in(text);
+        std::string line;
+        while(std::getline(in, line)){
+            std::istringstream ls(line);
+            std::string name;
+            if(!(ls >> name) || name[0]=='#' || name=="version") continue;
+            forEachParam([&](const char* n, double* v, int count, const ParamBounds&){
+                if(name!=n) return;
+                for(int i=0;i<count;i++) if(!(ls >> v[i])) break;
+            });
+        }
         return true;
     }
+
     bool save(const std::string& path) const{
         std::ofstream out(path);
         if(!out) return false;
-        for(int i=0;i<6;i++){ if(i) out<<' '; out<<material[i]; }
-        out<<"\n";
-        for(int i=0;i<64;i++){ if(i) out<<' '; out<<pstPawn[i]; }
-        out<<"\n";
-        for(int i=0;i<64;i++){ if(i) out<<' '; out<<pstKnight[i]; }
-        out<<"\n";
+        out<<"# chess_ai weights：每行「名稱 值…」\n";
+        out<<"version "<<WEIGHTS_VERSION<<"\n";
+        const_cast<Weights*>(this)->forEachParam([&](const char* name, double* v, int count, const ParamBounds&){
+            out<<name;
+            for(int i=0;i<count;i++) out<<' '<<v[i];
+            out<<"\n";
+        });
         return true;
     }
 };
@@ -79,6 +334,29 @@ struct Position {
     // castling rights bitmask: 1=WK,2=WQ,4=BK,8=BQ
     uint8_t castle=0;
 
+    // Zobrist key：makeMove 增量更新，unmakeMove 直接從 Undo 還原
+    uint64_t key=0;
+    uint64_t pawnKey=0;   // 只含兵的 key（pawn hash 用）
+
+    // 每種棋子的數量與 material key（只看組成、不看位置；第 n 顆 pc 貢獻 ZOBRIST.piece[pc][n]）
+    int pieceCount[13]{};
+    uint64_t materialKey=0;
+    int phase=0;          // Σ PHASE_INC，升變後可能超過 PHASE_MAX
+
+    // 子力 + PST 的增量總和：[顏色][MG/EG]。psqt 為 nullptr（沒掛表）時不維護
+    const PsqTable* psqt=nullptr;
+    int psqScore[2][2]{};
+
+    // 王的位置快取（[0]=白, [1]=黑），搜尋中每個節點都要判斷將軍
+    int kingSq[2]{-1,-1};
+
+    // 與 b[] 同步的 bitboard（評估的攻擊圖用）；makeMove / unmakeMove 以 XOR 增量維護
+    uint64_t pieceBB[13]{};   // [EMPTY] 不用
+    uint64_t colorBB[2]{};
+
+    // NNUE 累加器堆疊（搜尋執行緒各一份）；nullptr 時 makeMove 不記差分
+    NnueStack* nnue=nullptr;
+
     static int fileOf(int sq){ return sq & 7; }
     static int rankOf(int sq){ return sq >> 3; }
     static bool onBoard(int sq){ return sq>=0 && sq<64; }
@@ -97,6 +375,12 @@ struct Position {
         halfmoveClock=0;
         epSq=-1;
         castle = 1|2|4|8; // KQkq
+        key = computeKey();
+        pawnKey = computePawnKey();
+        refreshMaterial();
+        refreshPsq();
+        refreshKings();
+        refreshBitboards();
     }
 
     // 解析標準 FEN（piece placement / active color / castling / ep / halfmove / fullmove）
@@ -182,12 +466,107 @@ struct Position {
         }catch(...){
             halfmoveClock = 0;
         }
+
+        key = computeKey();
+        pawnKey = computePawnKey();
+        refreshMaterial();
+        refreshPsq();
+        refreshKings();
+        refreshBitboards();
+    }
+
+    // 只給盤面與走子方（沒有易位權、吃過路兵），例如 trainer 從打包的資料集還原局面
+    void setBoard(const std::array<Piece,64>& board, bool white){
+        b = board;
+        whiteToMove = white;
+        halfmoveClock = 0;
+        epSq = -1;
+        castle = 0;
+        key = computeKey();
+        pawnKey = computePawnKey();
+        refreshMaterial();
+        refreshPsq();
+        refreshKings();
+        refreshBitboards();
+    }
+
+    void refreshKings(){
+        kingSq[0] = kingSq[1] = -1;
+        for(int i=0;i<64;i++){
+            if(b[i]==WK) kingSq[0]=i;
+            if(b[i]==BK) kingSq[1]=i;
+        }
+    }
+
+    void refreshBitboards(){
+        std::fill(std::begin(pieceBB), std::end(pieceBB), 0);
+        colorBB[0] = colorBB[1] = 0;
+        for(int sq=0;sq<64;sq++) if(b[sq]!=EMPTY) toggleBB(b[sq], sq);
+    }
+
+    void toggleBB(Piece pc, int sq){
+        uint64_t m = 1ULL << sq;
+        pieceBB[pc] ^= m;
+        colorBB[isBlack(pc)] ^= m;
+    }
+
+    uint64_t occupied() const{ return colorBB[0] | colorBB[1]; }
+
+    uint64_t computeKey() const{
+        uint64_t k = 0;
+        for(int sq=0;sq<64;sq++) if(b[sq]!=EMPTY) k ^= ZOBRIST.piece[b[sq]][sq];
+        k ^= ZOBRIST.castle[castle];
+        if(epSq>=0) k ^= ZOBRIST.epFile[fileOf(epSq)];
+        if(!whiteToMove) k ^= ZOBRIST.side;
+        return k;
+    }
+
+    void addCount(Piece pc){
+        materialKey ^= ZOBRIST.piece[pc][pieceCount[pc]++];
+        phase += PHASE_INC[pc];
+    }
+    void removeCount(Piece pc){
+        materialKey ^= ZOBRIST.piece[pc][--pieceCount[pc]];
+        phase -= PHASE_INC[pc];
+    }
+
+    void refreshMaterial(){
+        std::fill(std::begin(pieceCount), std::end(pieceCount), 0);
+        materialKey = 0;
+        phase = 0;
+        for(int sq=0;sq<64;sq++) if(b[sq]!=EMPTY) addCount(b[sq]);
+    }
+
+    void setPsqTable(const PsqTable* t){
+        psqt = t;
+        refreshPsq();
+    }
+
+    void refreshPsq(){
+        psqScore[0][MG] = psqScore[0][EG] = psqScore[1][MG] = psqScore[1][EG] = 0;
+        if(!psqt) return;
+        for(int sq=0;sq<64;sq++) if(b[sq]!=EMPTY) psqAdd(b[sq], sq);
+    }
+
+    void psqAdd(Piece pc, int sq){
+        int c = isBlack(pc);
+        psqScore[c][MG] += psqt->at(MG, pc, sq);
+        psqScore[c][EG] += psqt->at(EG, pc, sq);
+    }
+    void psqRemove(Piece pc, int sq){
+        int c = isBlack(pc);
+        psqScore[c][MG] -= psqt->at(MG, pc, sq);
+        psqScore[c][EG] -= psqt->at(EG, pc, sq);
+    }
+
+    uint64_t computePawnKey() const{
+        uint64_t k = ZOBRIST.noPawns;
+        for(int sq=0;sq<64;sq++) if(b[sq]==WP || b[sq]==BP) k ^= ZOBRIST.piece[b[sq]][sq];
+        return k;
     }
 
     int findKingSq(bool white) const{
-        Piece k = white ? WK : BK;
-        for(int i=0;i<64;i++) if(b[i]==k) return i;
-        return -1;
+        return kingSq[white ? 0 : 1];
     }
 
     bool squareAttacked(int targetSq, bool byWhite) const{
@@ -300,6 +679,7 @@ struct Position {
     }
 
     void makeMove(const Move& m, Undo& u){
+        NnueAccumulator* dirty = nnue ? &nnue->push() : nullptr;
         u.captured = b[m.to];
         u.halfmoveClock = halfmoveClock;
         u.epSq = epSq;
@@ -309,6 +689,10 @@ struct Position {
 
         Piece p = b[m.from];
         u.movedPiece = p;
+        u.key = key;
+        u.pawnKey = pawnKey;
+        u.materialKey = materialKey;
+        std::copy(&psqScore[0][0], &psqScore[0][0]+4, &u.psqScore[0][0]);
 
         // reset ep by default
         epSq = -1;
@@ -349,6 +733,33 @@ struct Position {
         b[m.from]=EMPTY;
         Piece put = (m.promo!=EMPTY) ? m.promo : p;
         b[m.to]=put;
+        if(p==WK) kingSq[0]=m.to;
+        if(p==BK) kingSq[1]=m.to;
+
+        key ^= ZOBRIST.piece[p][m.from] ^ ZOBRIST.piece[put][m.to];
+        if(u.wasEP) key ^= ZOBRIST.piece[u.captured][u.epCapturedSq];
+        else if(u.captured!=EMPTY) key ^= ZOBRIST.piece[u.captured][m.to];
+        if(p==WP || p==BP){
+            pawnKey ^= ZOBRIST.piece[p][m.from];
+            if(put==p) pawnKey ^= ZOBRIST.piece[p][m.to];
+        }
+        if(u.captured==WP || u.captured==BP)
+            pawnKey ^= ZOBRIST.piece[u.captured][u.wasEP ? u.epCapturedSq : m.to];
+        if(u.captured!=EMPTY) removeCount(u.captured);
+        if(put!=p){ removeCount(p); addCount(put); }
+        toggleBB(p, m.from);
+        toggleBB(put, m.to);
+        if(u.captured!=EMPTY) toggleBB(u.captured, u.wasEP ? u.epCapturedSq : m.to);
+        if(dirty){
+            dirty->sub(p, m.from);
+            dirty->add(put, m.to);
+            if(u.captured!=EMPTY) dirty->sub(u.captured, u.wasEP ? u.epCapturedSq : m.to);
+        }
+        if(psqt){
+            psqRemove(p, m.from);
+            psqAdd(put, m.to);
+            if(u.captured!=EMPTY) psqRemove(u.captured, u.wasEP ? u.epCapturedSq : m.to);
+        }
 
         // set ep target on double pawn push
         if(p==WP){
@@ -393,10 +804,12 @@ struct Position {
                 // white O-O: rook h1->f1
                 u.rookFrom=7; u.rookTo=5; u.rookPiece=b[5];
                 b[5]=WR; b[7]=EMPTY;
+                key ^= ZOBRIST.piece[WR][7] ^ ZOBRIST.piece[WR][5];
             }else{
                 // white O-O-O: rook a1->d1
                 u.rookFrom=0; u.rookTo=3; u.rookPiece=b[3];
                 b[3]=WR; b[0]=EMPTY;
+                key ^= ZOBRIST.piece[WR][0] ^ ZOBRIST.piece[WR][3];
             }
         }
         if(p==BK && m.from==60 && (m.to==62 || m.to==58)){
@@ -405,18 +818,50 @@ struct Position {
                 // black O-O: rook h8->f8
                 u.rookFrom=63; u.rookTo=61; u.rookPiece=b[61];
                 b[61]=BR; b[63]=EMPTY;
+                key ^= ZOBRIST.piece[BR][63] ^ ZOBRIST.piece[BR][61];
             }else{
                 // black O-O-O: rook a8->d8
                 u.rookFrom=56; u.rookTo=59; u.rookPiece=b[59];
                 b[59]=BR; b[56]=EMPTY;
+                key ^= ZOBRIST.piece[BR][56] ^ ZOBRIST.piece[BR][59];
+            }
+        }
+
+        if(u.wasCastle){
+            Piece rook = p==WK ? WR : BR;
+            toggleBB(rook, u.rookFrom);
+            toggleBB(rook, u.rookTo);
+            if(dirty){
+                dirty->sub(rook, u.rookFrom);
+                dirty->add(rook, u.rookTo);
             }
         }
+        if(psqt && u.wasCastle){
+            Piece rook = p==WK ? WR : BR;
+            psqRemove(rook, u.rookFrom);
+            psqAdd(rook, u.rookTo);
+        }
+
+        key ^= ZOBRIST.castle[u.castle] ^ ZOBRIST.castle[castle] ^ ZOBRIST.side;
+        if(u.epSq>=0) key ^= ZOBRIST.epFile[fileOf(u.epSq)];
+        if(epSq>=0)   key ^= ZOBRIST.epFile[fileOf(epSq)];
 
         whiteToMove = !whiteToMove;
     }
 
     void unmakeMove(const Move& m, const Undo& u){
+        if(nnue) nnue->pop();
         whiteToMove = !whiteToMove;
+        key = u.key;
+        pawnKey = u.pawnKey;
+        materialKey = u.materialKey;
+        std::copy(&u.psqScore[0][0], &u.psqScore[0][0]+4, &psqScore[0][0]);
+        if(u.captured!=EMPTY){ pieceCount[u.captured]++; phase += PHASE_INC[u.captured]; }
+        if(m.promo!=EMPTY){
+            pieceCount[m.promo]--;
+            pieceCount[u.movedPiece]++;
+            phase -= PHASE_INC[m.promo];
+        }
         halfmoveClock = u.halfmoveClock;
         epSq = u.epSq;
         castle = u.castle;
@@ -425,14 +870,24 @@ struct Position {
         if(u.wasCastle){
             // king already moved back below; restore rook
             if(u.rookFrom!=-1 && u.rookTo!=-1){
-                b[u.rookFrom] = (isWhite(u.movedPiece)?WR:BR);
+                Piece rook = isWhite(u.movedPiece) ? WR : BR;
+                b[u.rookFrom] = rook;
                 b[u.rookTo] = EMPTY;
+                toggleBB(rook, u.rookFrom);
+                toggleBB(rook, u.rookTo);
             }
         }
 
+        // bitboard：與 makeMove 相同的 XOR 再做一次即還原
+        toggleBB(m.promo!=EMPTY ? m.promo : u.movedPiece, m.to);
+        toggleBB(u.movedPiece, m.from);
+        if(u.captured!=EMPTY) toggleBB(u.captured, u.wasEP ? u.epCapturedSq : m.to);
+
         // move piece back
         Piece moved = u.movedPiece; // original (pre-promo)
         b[m.from] = moved;
+        if(moved==WK) kingSq[0]=m.from;
+        if(moved==BK) kingSq[1]=m.from;
 
         // restore capture square
         b[m.to] = u.captured;
@@ -445,7 +900,8 @@ struct Position {
         }
     }
 
-    void genPseudoLegalMoves(std::vector<Move>& out) const{
+    template<class List>
+    void genPseudoLegalMoves(List& out) const{
         out.clear();
         bool stmW = whiteToMove;
 
@@ -523,7 +979,7 @@ struct Position {
                 continue;
             }
 
-            auto slide = [&](const std::vector<int>& dirs){
+            auto slide = [&](std::initializer_list<int> dirs){
                 for(int dv:dirs){
                     int to=sq;
                     while(true){
@@ -594,86 +1050,1438 @@ struct Position {
         }
     }
 
-    void genLegalMoves(std::vector<Move>& out) {
-        std::vector<Move> pseudo;
-        genPseudoLegalMoves(pseudo);
-
-        out.clear();
-        out.reserve(pseudo.size());
+    // List 可以是 std::vector<Move> 或 MoveList；就地過濾掉會讓自己被將軍的偽合法著
+    template<class List>
+    void genLegalMoves(List& out) {
+        genPseudoLegalMoves(out);
 
-        for(const auto& m : pseudo){
-            Position p2 = *this;
+        bool us = whiteToMove;
+        size_t n = 0;
+        for(size_t i=0;i<out.size();i++){
+            Move m = out[i];
             Undo u;
-            p2.makeMove(m,u);
+            makeMove(m,u);
+            bool legal = !isInCheck(us);
+            unmakeMove(m,u);
+            if(legal) out[n++] = m;
+        }
+        out.resize(n);
+    }
+};
 
-            // 走完後，輪到對方走，所以檢查「剛剛走的人」是否把自己王送進將軍
-            bool movedWasWhite = !p2.whiteToMove;
-            if(!p2.isInCheck(movedWasWhite)){
-                out.push_back(m);
+// =========================
+// SEE（Static Exchange Evaluation）
+// =========================
+// 只看目標格上的一連串互吃，每次都用最便宜的攻擊子；移走的子會讓後面的滑子 x-ray 出來。
+inline int seeValue(Piece p){
+    static const int v[13]={0, 100,320,330,500,900,20000, 100,320,330,500,900,20000};
+    return v[p];
+}
+
+inline bool isTactical(const Position& pos, const Move& m){
+    if(m.captured!=EMPTY || m.promo!=EMPTY) return true;
+    Piece p = pos.b[m.from];
+    return (p==WP || p==BP) && m.to==pos.epSq;
+}
+
+// 在 bb 上找 side 攻擊 sq 的最便宜棋子，回傳其所在格（-1 = 沒有）
+inline int leastAttacker(const std::array<Piece,64>& bb, int sq, bool white){
+    int f=Position::fileOf(sq), r=Position::rankOf(sq);
+
+    // 兵
+    int pr = white ? r-1 : r+1;
+    if(pr>=0 && pr<8){
+        for(int df : {-1,+1}){
+            int pf=f+df;
+            if(pf<0||pf>=8) continue;
+            int from=pr*8+pf;
+            if(bb[from]==(white?WP:BP)) return from;
+        }
+    }
+    // 馬
+    static const int nd[8][2]={{1,2},{2,1},{2,-1},{1,-2},{-1,-2},{-2,-1},{-2,1},{-1,2}};
+    for(const auto& d : nd){
+        int nf=f+d[0], nr=r+d[1];
+        if(nf<0||nf>=8||nr<0||nr>=8) continue;
+        if(bb[nr*8+nf]==(white?WN:BN)) return nr*8+nf;
+    }
+    // 滑子：依 象 -> 車 -> 后 的價值順序各掃一次
+    static const int diag[4][2]={{1,1},{1,-1},{-1,1},{-1,-1}};
+    static const int orth[4][2]={{1,0},{-1,0},{0,1},{0,-1}};
+    auto ray = [&](const int (*dirs)[2], Piece want) -> int{
+        for(int k=0;k<4;k++){
+            int cf=f+dirs[k][0], cr=r+dirs[k][1];
+            while(cf>=0&&cf<8&&cr>=0&&cr<8){
+                Piece q=bb[cr*8+cf];
+                if(q!=EMPTY){ if(q==want) return cr*8+cf; break; }
+                cf+=dirs[k][0]; cr+=dirs[k][1];
             }
         }
+        return -1;
+    };
+    int from;
+    if((from=ray(diag, white?WB:BB))>=0) return from;
+    if((from=ray(orth, white?WR:BR))>=0) return from;
+    if((from=ray(diag, white?WQ:BQ))>=0) return from;
+    if((from=ray(orth, white?WQ:BQ))>=0) return from;
+    // 王
+    for(int df=-1;df<=1;df++) for(int dr=-1;dr<=1;dr++){
+        if(!df && !dr) continue;
+        int kf=f+df, kr=r+dr;
+        if(kf<0||kf>=8||kr<0||kr>=8) continue;
+        if(bb[kr*8+kf]==(white?WK:BK)) return kr*8+kf;
+    }
+    return -1;
+}
+
+// 走 m 之後目標格互吃的淨得失（走子方視角）
+inline int see(const Position& pos, const Move& m){
+    std::array<Piece,64> bb = pos.b;
+    Piece mover = bb[m.from];
+    bool white = isWhite(mover);
+
+    int gain[32];
+    int d = 0;
+    int capSq = m.to;
+    Piece victim = bb[m.to];
+    if((mover==WP || mover==BP) && m.to==pos.epSq && victim==EMPTY){
+        capSq = white ? m.to-8 : m.to+8;
+        victim = bb[capSq];
+        bb[capSq] = EMPTY;
+    }
+
+    gain[0] = seeValue(victim);
+    Piece onSq = (m.promo!=EMPTY) ? m.promo : mover;
+    if(m.promo!=EMPTY) gain[0] += seeValue(m.promo) - seeValue(mover);
+    bb[m.from] = EMPTY;
+    bb[m.to] = onSq;
+
+    bool side = !white;
+    while(d < 31){
+        int from = leastAttacker(bb, m.to, side);
+        if(from < 0) break;
+        d++;
+        gain[d] = seeValue(onSq) - gain[d-1];
+        onSq = bb[from];
+        bb[from] = EMPTY;
+        bb[m.to] = onSq;
+        side = !side;
+    }
+    while(d > 0){
+        gain[d-1] = -std::max(-gain[d-1], gain[d]);
+        d--;
+    }
+    return gain[0];
+}
+
+// =========================
+// 評估展開（批次評估 / Texel 調參用）
+// =========================
+// 評估各項照常計算，同時記下「哪個參數、係數多少」；係數先乘好 MG / EG 的階段權重，
+// 同一個參數出現多次就合併。參數編號就是 forEachParam 的攤平順序（和 trainer 的 ParamView 一致）。
+struct EvalTrace {
+    const Weights* w;
+    std::vector<int> slot;          // Weights 裡第 i 個 double -> 參數編號（-1 = 不是參數）
+    std::vector<float> coef;
+    std::vector<uint8_t> used;
+    std::vector<int> touched;
+    float mgf=1, egf=0;
+
+    explicit EvalTrace(const Weights& weights): w(&weights){
+        const double* base = reinterpret_cast<const double*>(&weights);
+        slot.assign(sizeof(Weights) / sizeof(double), -1);
+        int n = 0;
+        const_cast<Weights&>(weights).forEachParam([&](const char*, double* v, int count, const ParamBounds&){
+            for(int i=0;i<count;i++) slot[v + i - base] = n++;
+        });
+        coef.assign(n, 0.0f);
+        used.assign(n, 0);
+    }
+
+    int params() const{ return (int)coef.size(); }
+
+    void begin(int phase){
+        mgf = phase / (float)PHASE_MAX;
+        egf = 1.0f - mgf;
+    }
+
+    // param 必須指向 *w 裡的參數；mg / eg 是該參數在兩個階段各自的係數
+    void add(const double* param, float mg, float eg){
+        int i = slot[param - reinterpret_cast<const double*>(w)];
+        if(!used[i]){ used[i] = 1; touched.push_back(i); }
+        coef[i] += mg * mgf + eg * egf;
+    }
+
+    void take(std::vector<BatchTerm>& out){
+        out.clear();
+        for(int i : touched){
+            if(coef[i] != 0.0f) out.push_back(BatchTerm{(int16_t)i, coef[i]});
+            coef[i] = 0.0f;
+            used[i] = 0;
+        }
+        touched.clear();
+    }
+};
+
+// =========================
+// 兵型評估
+// =========================
+// 只看兵的位置，結果存進 pawn hash 重複使用。
+// 填好 e 的分數與各種兵 bitboard（e.key 由呼叫端負責）。W 是 Weights 或 EvalConstants；trace 只能配 Weights
+template<class W>
+inline void evalPawns(const Position& pos, const W& w, PawnEntry& e, EvalTrace* trace=nullptr){
+    const uint64_t pawns[2]{pos.pieceBB[WP], pos.pieceBB[BP]};
+
+    double score[2]{0,0};
+    for(int c=0;c<2;c++){
+        bool white = c==0;
+        uint64_t own = pawns[c], enemy = pawns[c^1];
+        uint64_t enemyAttacks = pawnAttacksBB(!white, enemy);
+        e.attacks[c] = pawnAttacksBB(white, own);
+        e.passed[c] = 0;
+        e.attackSpan[c] = 0;
+
+        for(uint64_t bb = own; bb; ){
+            int sq = popLsb(bb);
+            int f = sq & 7;
+            int rel = white ? (sq >> 3) : 7 - (sq >> 3);
+            uint64_t ahead = forwardRanksBB(white, sq);
+            uint64_t neighbours = adjacentFilesBB(f);
+            e.attackSpan[c] |= ahead & neighbours;
+
+            bool doubled  = (own & ahead & fileBB(f)) != 0;
+            bool isolated = (own & neighbours) == 0;
+            bool passed   = !doubled && !(enemy & ahead & (fileBB(f) | neighbours));
+
+            // 落後兵：相鄰線上沒有同排或更後面的己兵能支援，而且前進格被敵兵控制
+            uint64_t stop = rel<7 ? (white ? 1ULL << (sq+8) : 1ULL << (sq-8)) : 0;
+            bool backward = !isolated && !(own & neighbours & ~ahead) && (enemyAttacks & stop);
+
+            if(doubled) score[c] -= w.doubledPawn;
+            if(isolated) score[c] -= w.isolatedPawn;
+            else if(backward) score[c] -= w.backwardPawn;
+            if(passed){
+                e.passed[c] |= 1ULL << sq;
+                score[c] += w.passedPawn[rel];
+            }
+            if(trace){
+                float sign = white ? 1.0f : -1.0f;
+                if(doubled) trace->add(&w.doubledPawn, -sign, -sign);
+                if(isolated) trace->add(&w.isolatedPawn, -sign, -sign);
+                else if(backward) trace->add(&w.backwardPawn, -sign, -sign);
+                if(passed) trace->add(&w.passedPawn[rel], sign, sign);
+            }
+        }
+    }
+    e.score = (int16_t)std::llround(score[0] - score[1]);
+}
+
+// =========================
+// 機動力與王區攻擊
+// =========================
+// 一次攻擊圖掃描：每顆 N/B/R/Q 的攻擊只算一次，同時拿來數機動力與王區攻擊（白方視角，已依階段內插）。
+// 機動力只數安全格：扣掉己方棋子與敵兵控制的格子。王區 = 敵王所在格加周圍 8 格。
+inline int evalActivity(const Position& pos, const ActivityTable& t, EvalTrace* trace=nullptr){
+    const uint64_t occ = pos.occupied();
+    int mg = 0, eg = 0;
+    for(int c=0;c<2;c++){
+        bool white = c==0;
+        int sign = white ? 1 : -1;
+        uint64_t area = ~pos.colorBB[c] & ~pawnAttacksBB(!white, pos.pieceBB[white ? BP : WP]);
+        int ksq = pos.kingSq[c^1];
+        uint64_t zone = ksq>=0 ? ATTACKS.king[ksq] | 1ULL << ksq : 0;
+
+        for(int pt=0;pt<4;pt++){
+            for(uint64_t bb = pos.pieceBB[(white ? WN : BN) + pt]; bb; ){
+                int sq = popLsb(bb);
+                uint64_t att = pt==0 ? ATTACKS.knight[sq]
+                             : pt==1 ? bishopAttacks(sq, occ)
+                             : pt==2 ? rookAttacks(sq, occ)
+                             : bishopAttacks(sq, occ) | rookAttacks(sq, occ);
+                int mob = popcount(att & area), kz = popcount(att & zone);
+                mg += sign * (t.mobility[MG][pt][mob] + t.kingAttack[pt] * kz);
+                eg += sign * t.mobility[EG][pt][mob];
+                if(trace){
+                    trace->add(&trace->w->mobility[MG][pt], float(sign * (mob - MOBILITY_BASE[pt])), 0);
+                    trace->add(&trace->w->mobility[EG][pt], 0, float(sign * (mob - MOBILITY_BASE[pt])));
+                    if(kz) trace->add(&trace->w->kingAttack[pt], float(sign * kz), 0);
+                }
+            }
+        }
+    }
+    int ph = std::min(pos.phase, PHASE_MAX);
+    return (mg * ph + eg * (PHASE_MAX - ph)) / PHASE_MAX;
+}
+
+// =========================
+// 子力組成評估（material hash）
+// =========================
+// 只依每種棋子的數量計算，結果存進 material hash。殘局縮放以 64 為 1 倍。
+constexpr int SCALE_NORMAL = 64;
+constexpr int BISHOP_PAIR = 40;
+// Kaufman：以 5 個兵為基準，每多一個兵騎士 +6、車 -12（兵越多騎士越好用、車越難開線）
+constexpr int KNIGHT_PAWN_ADJ = 6;
+constexpr int ROOK_PAWN_ADJ = 12;
+
+inline void evalMaterial(const Position& pos, MaterialEntry& e){
+    const int* cnt = pos.pieceCount;
+    int pawns[2] = {cnt[WP], cnt[BP]};
+    int knights[2] = {cnt[WN], cnt[BN]};
+    int bishops[2] = {cnt[WB], cnt[BB]};
+    int rooks[2] = {cnt[WR], cnt[BR]};
+    int queens[2] = {cnt[WQ], cnt[BQ]};
+
+    int npm[2], imb[2];
+    for(int c=0;c<2;c++){
+        npm[c] = knights[c]*seeValue(WN) + bishops[c]*seeValue(WB) + rooks[c]*seeValue(WR) + queens[c]*seeValue(WQ);
+        imb[c] = (bishops[c]>=2 ? BISHOP_PAIR : 0)
+               + knights[c] * (pawns[c]-5) * KNIGHT_PAWN_ADJ
+               - rooks[c] * (pawns[c]-5) * ROOK_PAWN_ADJ;
+    }
+    e.imbalance = (int16_t)(imb[0] - imb[1]);
+
+    e.phase = (uint8_t)std::min(pos.phase, PHASE_MAX);
+
+    // 沒有兵、子力領先不到一個象：幾乎贏不了（KRKR、KRKB、KBKN…）
+    for(int c=0;c<2;c++){
+        e.scale[c] = SCALE_NORMAL;
+        if(!pawns[c] && npm[c] - npm[c^1] <= seeValue(WB))
+            e.scale[c] = npm[c] < seeValue(WR) ? 0 : npm[c^1] <= seeValue(WB) ? 4 : 14;
+    }
+    e.bishopsOnly = bishops[0]==1 && bishops[1]==1 && npm[0]==seeValue(WB) && npm[1]==seeValue(WB);
+
+    // 特化殘局
+    e.endgame = EG_NONE;
+    e.strongSide = npm[0]+pawns[0]*100 >= npm[1]+pawns[1]*100 ? 0 : 1;
+    int s = e.strongSide, wk = s^1;
+    bool loneKing = !pawns[wk] && !npm[wk];
+    if(!pawns[0] && !pawns[1]){
+        bool minorOnly[2];
+        for(int c=0;c<2;c++) minorOnly[c] = npm[c] <= seeValue(WB) || (npm[c]==2*seeValue(WN) && knights[c]==2);
+        if(minorOnly[0] && minorOnly[1] && (npm[0] <= seeValue(WB) || npm[1] <= seeValue(WB))){
+            if(loneKing || npm[s] <= seeValue(WB)) e.endgame = EG_DRAW;
+        }
+    }
+    if(e.endgame==EG_NONE && loneKing){
+        if(!pawns[s] && knights[s]==1 && bishops[s]==1 && !rooks[s] && !queens[s]) e.endgame = EG_KBNK;
+        else if(rooks[s] || queens[s] || bishops[s]>=2 || (bishops[s] && knights[s]) || knights[s]>=3) e.endgame = EG_KXK;
+    }
+}
+
+// 特化殘局的分數（白方視角）：優勢方先拿 KNOWN_WIN，再依弱方王被逼到哪裡細分
+constexpr int KNOWN_WIN = 10000;
+
+inline int kingDistance(int a, int b){
+    return std::max(std::abs(Position::fileOf(a)-Position::fileOf(b)), std::abs(Position::rankOf(a)-Position::rankOf(b)));
+}
+inline int edgeDistance(int sq){
+    int f = Position::fileOf(sq), r = Position::rankOf(sq);
+    return std::min(std::min(f, 7-f), std::min(r, 7-r));
+}
+
+inline int evalEndgame(const Position& pos, const MaterialEntry& e){
+    if(e.endgame==EG_DRAW) return 0;
+
+    bool white = e.strongSide==0;
+    int strongK = pos.findKingSq(white), weakK = pos.findKingSq(!white);
+    int npm = 0;
+    for(int pc=white?WN:BN; pc<=(white?WQ:BQ); pc++) npm += pos.pieceCount[pc] * seeValue((Piece)pc);
+    int score = KNOWN_WIN + npm + 100 * pos.pieceCount[white?WP:BP]
+              + 10 * (7 - kingDistance(strongK, weakK));
+
+    if(e.endgame==EG_KBNK){
+        // a1 是暗格：象在暗格就趕向 a1/h8，否則 a8/h1
+        int bishopSq = -1;
+        for(int sq=0;sq<64;sq++) if(pos.b[sq]==(white?WB:BB)) bishopSq = sq;
+        bool dark = ((Position::fileOf(bishopSq) + Position::rankOf(bishopSq)) & 1) == 0;
+        int c1 = dark ? 0 : 56, c2 = dark ? 63 : 7;
+        score += 40 * (7 - std::min(kingDistance(weakK, c1), kingDistance(weakK, c2)));
+    }else{
+        score += 30 * (3 - edgeDistance(weakK));
+    }
+    return white ? score : -score;
+}
+
+inline bool oppositeBishops(const Position& pos){
+    int color[2] = {-1, -1};
+    for(int sq=0;sq<64;sq++){
+        if(pos.b[sq]==WB) color[0] = (Position::fileOf(sq) + Position::rankOf(sq)) & 1;
+        if(pos.b[sq]==BB) color[1] = (Position::fileOf(sq) + Position::rankOf(sq)) & 1;
+    }
+    return color[0] >= 0 && color[1] >= 0 && color[0] != color[1];
+}
+
+// =========================
+// 將死分數
+// =========================
+// 在 ply 被將死 = -(MATE - ply)：越快的殺越大。|score| >= MATE_BOUND 即為殺棋分數。
+constexpr int MAX_PLY    = 128;
+constexpr int MATE       = 32000;
+constexpr int MATE_BOUND = MATE - MAX_PLY;
+// 樹內 TB 勝負的分數放在殺棋分數之下：不會被當成 mate N，仍比任何評估大；TB_WIN - ply 也帶距離
+constexpr int TB_WIN     = MATE_BOUND - 1;
+constexpr int TB_BOUND   = TB_WIN - MAX_PLY;
+
+inline int matedIn(int ply){ return -MATE + ply; }
+inline int mateIn(int ply){ return MATE - ply; }
+
+// TT 存「距離此節點」的殺棋 / TB 勝負步數，讀回時再換成距離根節點
+inline int scoreToTT(int s, int ply){
+    return s >= TB_BOUND ? s + ply : s <= -TB_BOUND ? s - ply : s;
+}
+inline int scoreFromTT(int s, int ply){
+    return s >= TB_BOUND ? s - ply : s <= -TB_BOUND ? s + ply : s;
+}
+
+// UCI 的 mate N 以「自己走的步數」計，負數代表被殺
+inline int mateMoves(int s){
+    return s > 0 ? (MATE - s + 1) / 2 : -(MATE + s) / 2;
+}
+
+// =========================
+// 殘局庫查詢（tablebase.hpp）
+// =========================
+// 子數夠少、沒有易位權、也不能吃過路兵（索引不含這兩種狀態）時才轉成 tb::Board
+inline bool toTbBoard(const Position& pos, int maxPieces, tb::Board& out){
+    uint64_t occ = pos.occupied();
+    if(popcount(occ) > maxPieces || pos.castle) return false;
+    if(pos.epSq >= 0 && (pawnAttacksBB(!pos.whiteToMove, 1ULL << pos.epSq) & pos.pieceBB[pos.whiteToMove ? WP : BP]))
+        return false;
+    out.n = 0;
+    out.stm = pos.whiteToMove ? 0 : 1;
+    while(occ){
+        int sq = popLsb(occ);
+        Piece pc = pos.b[sq];
+        bool white = isWhite(pc);
+        out.p[out.n++] = tb::PieceSq{(int8_t)(white ? pc : pc - 6), (int8_t)(white ? 0 : 1), (int8_t)sq};
+    }
+    return true;
+}
+
+// =========================
+// 搜尋堆疊（每執行緒一份，預先配置）
+// =========================
+// 每個 ply 一格：目前著法、靜態評估、killer、continuation history 指標、三角 PV 與該層的著法清單。
+// 前面多留 STACK_OFFSET 格哨兵，根節點也能直接讀 ss-1 / ss-2。搜尋中不做任何配置。
+using ContHistEntry = int16_t[13][64];   // [下一步的棋子][下一步的目標格]
+constexpr int CONT_HIST_MAX = 16384;
+
+struct StackEntry {
+    int ply=0;
+    Move currentMove{};
+    Piece movedPiece=EMPTY;            // EMPTY = 沒有著法（哨兵 / 根節點之前）
+    int staticEval=0;
+    Move killers[2]{};
+    ContHistEntry* contHist=nullptr;   // 指向 [movedPiece][currentMove.to]，子節點排序用
+    int pvLen=0;
+    Move pv[MAX_PLY+1];
+    MoveList moves;
+    int scores[MAX_MOVES];
+};
+
+constexpr int STACK_OFFSET = 2;
+constexpr int STACK_SIZE   = MAX_PLY + STACK_OFFSET + 2;
+
+// =========================
+// 平行搜尋：Young Brothers Wait (YBWC)
+// =========================
+// 長子（第一個子節點）搜完後才建立分裂點，閒置執行緒從分裂點偷兄弟子樹來搜；
+// 分裂點共用 alpha/beta 與 cutoff 旗標，某執行緒 fail-high 時其餘執行緒盡快放棄。
+enum ParallelMode : int {
+    PAR_OFF = 0,   // 單執行緒
+    PAR_YBWC       // YBWC 分裂點搜尋
+};
+
+enum NodeType : int { NonPV, PV, Root };
+
+struct SplitPoint {
+    std::mutex m;
+    SplitPoint* parent=nullptr;       // 外層分裂點（cutoff 要往下傳）
+    Position pos;                     // 分裂節點局面（helper 加入時各自複製）
+    const MoveList* moves=nullptr;
+    std::atomic<size_t> next{0};      // 下一個尚未分配的兄弟
+    std::atomic<int> workers{0};      // 正在此分裂點工作的 helper 數
+    std::atomic<bool> cutoff{false};
+    int depth=0;
+    int ply=0;
+    bool pvNode=false;                // PV 分裂點：兄弟先零視窗，超過 alpha 再全視窗重搜
+    Move prevMove{};                  // 走到分裂節點的那一步：helper 重建自己的 ss-1
+    Piece prevPiece=EMPTY;
+    int alpha=0, beta=0;              // 以下受 m 保護
+    Move best{};
+    bool hasBest=false;
+    int pvLen=0;
+    Move pv[MAX_PLY+1];
+
+    bool hasWork() const{ return !cutoff && next < moves->size(); }
+};
+
+struct YbwcPool;
+
+// UCI 執行緒與搜尋執行緒之間的控制旗標（stop / ponderhit 由外部設定）
+struct SearchControl {
+    std::atomic<bool> stop{false};
+    std::atomic<bool> ponder{false};   // 想對手的時間：不依時間停止，ponderhit 時清掉
+};
+
+// 所有執行緒共用的搜尋狀態
+struct SearchShared {
+    std::atomic<bool> stop{false};
+    TimeManager tm;
+    SearchControl* control=nullptr;
+    bool canStop=false;       // 第一輪迭代一定搜完，保證有合法著可回
+
+    // 節點預算：單執行緒每個節點精確比對（可重現）；多執行緒每 1024 節點匯總一次
+    uint64_t nodeLimit=0;
+    bool singleThread=true;
+    std::atomic<uint64_t> nodesFlushed{0};
+
+    int mateTarget=1000000000;   // go mate N：根節點分數達到就收手
+
+    bool pondering() const{ return control && control->ponder; }
+};
+
+struct SearchThread {
+    int id=0;
+    uint64_t nodes=0;
+    SplitPoint* sp=nullptr;   // 目前所在的分裂點
+    YbwcPool* pool=nullptr;   // nullptr = 不分裂
+    SearchShared* shared=nullptr;
+
+    // 根節點（只有 master 會用）：從 rootMoves[pvIdx] 開始搜，結果寫回 rootBest
+    MoveList* rootMoves=nullptr;
+    int pvIdx=0;
+    Move rootBest{};
+
+    // 搜尋堆疊與 continuation history：跨搜尋保留，history 只在 ucinewgame 清掉
+    std::unique_ptr<StackEntry[]> stackBuf{new StackEntry[STACK_SIZE]};
+    std::unique_ptr<ContHistEntry[]> contHist{new ContHistEntry[13*64]()};
+    EvalCache evalCache;
+    PawnTable pawnTable;
+    MaterialTable materialTable;
+    NnueStack nnue;
+    uint64_t lazyExits[3]{};   // 每次搜尋歸零；沒命中 eval cache 的評估各在哪一段結束
+    uint64_t tbHits=0;
+
+    StackEntry* stack(int ply){ return &stackBuf[ply+STACK_OFFSET]; }
+    ContHistEntry* contHistFor(Piece p, int to){ return &contHist[p*64+to]; }
+
+    // 每次搜尋開始時呼叫：編 ply、清 killer；沒有著法的格子指向永遠為 0 的 EMPTY 列
+    void resetStack(){
+        for(int i=0;i<STACK_SIZE;i++){
+            StackEntry& e = stackBuf[i];
+            e.ply = i - STACK_OFFSET;
+            e.currentMove = Move{};
+            e.movedPiece = EMPTY;
+            e.killers[0] = e.killers[1] = Move{};
+            e.contHist = contHistFor(EMPTY, 0);
+            e.pvLen = 0;
+        }
+    }
+
+    void clearHistory(){
+        std::fill_n(&contHist[0][0][0], 13*64*13*64, (int16_t)0);
+    }
+
+    // 搜尋被叫停，或自己/任何祖先分裂點已經 cutoff：這條子樹的結果不會被用到
+    bool aborted() const{
+        if(shared && shared->stop) return true;
+        for(const SplitPoint* s=sp; s; s=s->parent) if(s->cutoff) return true;
+        return false;
+    }
+
+    // 每 TIME_CHECK_NODES 個節點看一次時鐘，超過 hard 上限就叫停所有執行緒
+    void pollTime(){
+        if(!shared || !shared->canStop) return;
+        if(shared->nodeLimit) pollNodes();
+        if(nodes & (TimeManager::TIME_CHECK_NODES-1)) return;
+        if(shared->control && shared->control->stop) shared->stop = true;
+        else if(!shared->pondering() && shared->tm.hardStop()) shared->stop = true;
+    }
+
+    void pollNodes(){
+        if(shared->singleThread){
+            if(nodes >= shared->nodeLimit) shared->stop = true;
+        }else if(!(nodes & (TimeManager::TIME_CHECK_NODES-1))){
+            uint64_t total = shared->nodesFlushed.fetch_add(TimeManager::TIME_CHECK_NODES) + TimeManager::TIME_CHECK_NODES;
+            if(total >= shared->nodeLimit) shared->stop = true;
+        }
+    }
+};
+
+// 每輪迭代結束回報給 UCI（MultiPV 時每個 slot 各一筆）
+struct SearchInfo {
+    int depth=0;
+    int multipv=1;
+    int score=0;
+    uint64_t nodes=0;
+    int64_t timeMs=0;
+    int hashfull=0;
+    uint64_t tbHits=0;
+    Move best{};
+    std::vector<Move> pv;
+};
+
+inline bool sameMove(const Move& a, const Move& b){
+    return a.from==b.from && a.to==b.to && a.promo==b.promo;
+}
+
+// TT 裡的著法只存 16 bits：from | to<<6 | promo<<12
+inline uint16_t packMove(const Move& m){
+    return (uint16_t)(m.from | (m.to << 6) | ((int)m.promo << 12));
+}
+inline bool matchesPacked(const Move& m, uint16_t packed){
+    return packed && packMove(m) == packed;
+}
+
+struct YbwcPool {
+    std::mutex m;
+    std::condition_variable cv;
+    std::vector<SplitPoint*> active;   // 可以被偷的分裂點
+    std::atomic<int> idle{0};
+    bool quit=false;
+
+    // 挑剩餘深度最大的分裂點，偷到的子樹最大、同步開銷比例最小
+    SplitPoint* pickSplit() const{
+        SplitPoint* pick=nullptr;
+        for(SplitPoint* s : active)
+            if(s->hasWork() && (!pick || s->depth > pick->depth)) pick=s;
+        return pick;
+    }
+};
+
+// 評估項開關（evalcost 量各項的 nps 成本用）；子力 + PST 永遠開著
+enum EvalTerm : unsigned {
+    TERM_MATERIAL = 1,   // 子力組成：imbalance、殘局縮放、特化殘局
+    TERM_PAWNS    = 2,   // 兵型
+    TERM_ACTIVITY = 4,   // 機動力 + 王區攻擊
+    TERM_ALL      = 7,
+};
+
+// 分段（lazy）評估在哪一段結束：只算子力 + PST、再加 pawn / material hash、全部算完
+enum LazyTier : int { LAZY_PSQ, LAZY_HASH, LAZY_FULL };
+
+// =========================
+// 評估器 policy
+// =========================
+// 搜尋（search / qsearch / YBWC helper）以評估器為模板參數：葉節點呼叫哪個評估在編譯期決定、可以內聯，
+// 不用每個葉子都判斷 net / evalTerms。bestMove、alphabeta、eval() 等入口只分派一次（Engine::withEvaluator）。
+// eval() 回傳白方視角；tier 回報 lazy 評估在哪一段結束。
+struct ClassicalEval {   // 古典評估、所有項都開：各項開關在編譯期折掉
+    static constexpr const char* NAME = "classical";
+    template<class E>
+    static int eval(const E& e, const Position& pos, PawnTable* pawns, MaterialTable* material, int lo, int hi, int* tier){
+        return e.evalClassical(e.w, pos, pawns, material, TERM_ALL, lo, hi, tier);
+    }
+};
+
+struct MaskedEval {   // 古典評估、依 Engine::evalTerms 開關各項（evalcost / trainer lazy 量成本用）
+    static constexpr const char* NAME = "masked";
+    template<class E>
+    static int eval(const E& e, const Position& pos, PawnTable* pawns, MaterialTable* material, int lo, int hi, int* tier){
+        return e.evalClassical(e.w, pos, pawns, material, e.evalTerms, lo, hi, tier);
+    }
+};
+
+#ifdef CHESS_EMBEDDED_WEIGHTS
+struct EmbeddedEval {   // 古典評估、所有項都開、參數是編進執行檔的 constexpr 表：兵型與王區攻擊的常數直接折進程式碼
+    static constexpr const char* NAME = "embedded";
+    template<class E>
+    static int eval(const E& e, const Position& pos, PawnTable* pawns, MaterialTable* material, int lo, int hi, int* tier){
+        return e.evalClassical(EMBEDDED_EVAL, pos, pawns, material, TERM_ALL, lo, hi, tier);
+    }
+};
+#endif
+
+struct NnueEval {   // Engine::net
+    static constexpr const char* NAME = "nnue";
+    template<class E>
+    static int eval(const E& e, const Position& pos, PawnTable*, MaterialTable*, int, int, int* tier){
+        if(tier) *tier = LAZY_FULL;
+        return e.nnueEval(pos);
     }
 };
 
 struct Engine {
+    static constexpr int INF = 1000000000;
+
     Weights w;
+    unsigned evalTerms = TERM_ALL;   // 改了要 clearHash（eval cache 不分開關）
+    std::shared_ptr<const NnueNetwork> net;   // 有載入就取代 PST 評估；Engine 複製時共用
+    std::shared_ptr<const tb::TableSet> tablebases;   // UCI TablebasePath；Engine 複製時共用
+    // lazy eval 的提早結束邊界：[0] 子力 + PST 之後、[1] 加上 hash 項之後（trainer lazy 可量合適的值）
+    int lazyMargin[2]{350, 150};
+
+    int threads=1;
+    ParallelMode parallel=PAR_YBWC;
+    int splitMinDepth=3;          // 剩餘深度太淺就不分裂，避免同步開銷大於收益
+
+    int64_t moveOverhead=30;      // 每步預留給 GUI / 通訊的毫秒數
+    static constexpr int MAX_DEPTH=64;
+
+    static constexpr int IIR_MIN_DEPTH=4;        // 沒有 TT 著法時先少搜一層
+    static constexpr int PROBCUT_MIN_DEPTH=5;
+    static constexpr int PROBCUT_MARGIN=200;     // beta + margin 以上才算「幾乎一定 fail-high」
+    static constexpr int PROBCUT_REDUCTION=4;
+
+    int multiPV=1;                // 同時回報前 K 個根著法
+    size_t hashMB=16;
+    std::shared_ptr<TranspositionTable> tt;   // 第一次搜尋才配置；Engine 複製時共用
+
+    // 每執行緒的搜尋堆疊與 history：第一次搜尋才配置、之後重複使用；Engine 複製時共用
+    std::shared_ptr<std::vector<std::unique_ptr<SearchThread>>> workers;
+
+    uint64_t lastNodes=0;         // 上一次 bestMove 的總節點數（所有執行緒）
+    uint64_t lastEvalProbes=0, lastEvalHits=0;   // 上一次 bestMove 的 eval cache 命中統計
+    uint64_t lastPawnProbes=0, lastPawnHits=0;   // 同上，pawn hash
+    uint64_t lastMaterialProbes=0, lastMaterialHits=0;   // 同上，material hash
+    uint64_t lastLazy[3]{};       // 同上，沒命中 eval cache 的評估各在哪一段結束（LazyTier）
+    uint64_t lastTbHits=0;        // 同上，樹內殘局庫命中數
+    std::vector<Move> lastPV;     // 上一次 bestMove 的主變例（第二步即 ponder 著法）
+    std::function<void(const SearchInfo&)> onIter;   // 每輪迭代完成時呼叫（可為空）
+    SearchControl* control=nullptr;                   // 非同步搜尋時由 UCI 執行緒持有
+
+    // 換上新權重：重新編譯查表，依舊權重算出的快取全部作廢
+    void setWeights(const Weights& nw){
+        w = nw;
+        w.compile();
+        clearHash();
+    }
+
+    // 讓 pos 之後的 makeMove 增量維護本引擎的子力 + PST（pos 不可活得比引擎久）
+    void attachPsq(Position& pos) const{
+        pos.setPsqTable(&w.psqt);
+    }
+
+    // UCI EvalFile：空字串或 <empty> 回到 PST 評估；讀檔失敗時保留原本的評估並回傳 false
+    bool loadNet(const std::string& path){
+        if(path.empty() || path=="<empty>") net.reset();
+        else{
+            auto n = NnueNetwork::fromFile(path);
+            if(!n) return false;
+            net = n;
+        }
+        clearHash();
+        return true;
+    }
+
+    // UCI TablebasePath：空字串或 <empty> 關掉；目錄裡一張表都沒有時保留原設定並回傳 false
+    bool loadTablebases(const std::string& dir){
+        if(dir.empty() || dir=="<empty>") tablebases.reset();
+        else{
+            auto s = tb::TableSet::fromDir(dir);
+            if(!s) return false;
+            tablebases = s;
+        }
+        clearHash();
+        return true;
+    }
+
+    bool probeWdl(const Position& pos, int& wdl) const{
+        tb::Board b;
+        return toTbBoard(pos, tablebases->maxPieces, b) && tablebases->probeWdl(b, wdl);
+    }
+
+    // 根節點在表裡：只留 DTM 最好的著法（能勝取最快殺、保和、必敗取最慢），之後照常搜尋。
+    // 任一子局面查不到（例如雙步後可吃過路兵）就不過濾
+    bool filterRootMoves(const Position& root, MoveList& moves) const{
+        tb::Board b;
+        if(!tablebases || !toTbBoard(root, tablebases->maxPieces, b)) return false;
+        Position pos = root;
+        pos.nnue = nullptr;
+        int rank[MAX_MOVES];
+        int best = -INF;
+        for(size_t i=0;i<moves.size();i++){
+            Undo u;
+            pos.makeMove(moves[i], u);
+            uint8_t v;
+            bool ok = toTbBoard(pos, tablebases->maxPieces, b) && tablebases->probeDtm(b, v);
+            pos.unmakeMove(moves[i], u);
+            if(!ok) return false;
+            rank[i] = tb::isLoss(v) ? 1000 - tb::dtmOf(v) : tb::isWin(v) ? -1000 + tb::dtmOf(v) : 0;
+            best = std::max(best, rank[i]);
+        }
+        size_t n = 0;
+        for(size_t i=0;i<moves.size();i++) if(rank[i]==best) moves[n++] = moves[i];
+        moves.n = n;
+        return true;
+    }
+
+    // 搜尋用的局面掛上 t 的累加器堆疊（在目前 top 之上重算一個根）；沒有網路就不掛
+    void attachNnue(SearchThread& t, Position& pos) const{
+        pos.nnue = nullptr;
+        if(!net) return;
+        t.nnue.pushRoot(net.get(), pos.b);
+        pos.nnue = &t.nnue;
+    }
+
+    int nnueEval(const Position& pos) const{
+        int sc = pos.nnue && pos.nnue->net == net.get() ? pos.nnue->evaluate(pos.whiteToMove)
+                                                        : nnueEvaluateFull(*net, pos.b, pos.whiteToMove);
+        return pos.whiteToMove ? sc : -sc;
+    }
+
+    // 入口分派評估器：有網路用 NNUE，各項全開用 ClassicalEval（權重是編進執行檔的那組時用 EmbeddedEval），
+    // 否則 MaskedEval。f 以評估器的空物件呼叫（f(ClassicalEval{}) …），每個評估器各展開一份搜尋
+    template<class F>
+    auto withEvaluator(F&& f) const{
+        if(net) return f(NnueEval{});
+#ifdef CHESS_EMBEDDED_WEIGHTS
+        if(evalTerms == TERM_ALL && w.embedded) return f(EmbeddedEval{});
+#endif
+        if(evalTerms == TERM_ALL) return f(ClassicalEval{});
+        return f(MaskedEval{});
+    }
+
+    const char* evaluatorName() const{
+        return withEvaluator([](auto ev){ return decltype(ev)::NAME; });
+    }
+
+    // 白方視角；表為 nullptr 時直接重算（搜尋中一律走各執行緒的 pawn / material hash）
+    int eval(const Position& pos, PawnTable* pawns=nullptr, MaterialTable* material=nullptr) const{
+        return withEvaluator([&](auto ev){ return decltype(ev)::eval(*this, pos, pawns, material, -INF, INF, nullptr); });
+    }
+
+    // 古典分段評估（白方視角）：每段之後，部分分數若已在 (lo - margin, hi + margin) 之外就直接回傳，
+    // 後面幾段改變不了呼叫端的結論。terms 是 EvalTerm 開關，tier 回報在哪一段結束。
+    // c 提供兵型參數與機動力表：w 本身，或編進執行檔的 EMBEDDED_EVAL（兩者內容相同時才可互換）
+    template<class C>
+    int evalClassical(const C& c, const Position& pos, PawnTable* pawns, MaterialTable* material, unsigned terms,
+                      int lo, int hi, int* tier=nullptr) const{
+        int dummy;
+        int& at = tier ? *tier : dummy;
+        at = LAZY_FULL;
+
+        // 第 1 段：增量的子力 + PST。雙方都有兵、也不是單象對單象時，殘局縮放必為 1 倍、不會是特化殘局
+        int sc = psqEval(pos);
+        if(pos.pieceCount[WP] && pos.pieceCount[BP] && pos.phase > 2
+           && (sc <= lo - lazyMargin[0] || sc >= hi + lazyMargin[0])){
+            at = LAZY_PSQ;
+            return sc;
+        }
+
+        // 第 2 段：pawn / material hash
+        MaterialEntry local;
+        const MaterialEntry* me = nullptr;
+        int scale = SCALE_NORMAL;
+        if(terms & TERM_MATERIAL){
+            me = &materialEntry(pos, material, local);
+            if(me->endgame != EG_NONE) return evalEndgame(pos, *me);
+            sc += me->imbalance;
+        }
+        if(terms & TERM_PAWNS) sc += pawnScore(c, pos, pawns);
+        auto scaled = [&](int v){
+            if(!me) return v;
+            scale = me->scale[v > 0 ? 0 : 1];
+            if(me->bishopsOnly && oppositeBishops(pos)) scale = std::min(scale, SCALE_NORMAL/2);
+            return v * scale / SCALE_NORMAL;
+        };
+
+        // 第 3 段：攻擊圖（機動力、王區攻擊）
+        if(terms & TERM_ACTIVITY){
+            int partial = scaled(sc);
+            if(partial <= lo - lazyMargin[1] || partial >= hi + lazyMargin[1]){
+                at = LAZY_HASH;
+                return partial;
+            }
+            sc += evalActivity(pos, c.activity);
+        }
+        return scaled(sc);
+    }
+
+    // eval() 的 PST 評估攤成線性形式（trainer 的批次評估用；NNUE 不適用）。tr 必須是用本引擎的 w 建的
+    void traceEval(const Position& pos, EvalTrace& tr, BatchEntry& out) const{
+        out.imbalance = 0;
+        out.scaleW = out.scaleB = SCALE_NORMAL;
+        out.fixed = false;
+        MaterialEntry me;
+        if(evalTerms & TERM_MATERIAL){
+            evalMaterial(pos, me);
+            if(me.endgame != EG_NONE){
+                out.terms.clear();
+                out.fixed = true;
+                out.fixedScore = (float)evalEndgame(pos, me);
+                return;
+            }
+        }
 
-    int eval(const Position& pos) const{
-        double score=0;
+        tr.begin(std::min(pos.phase, PHASE_MAX));
         for(int sq=0;sq<64;sq++){
-            Piece p=pos.b[sq];
-            if(p==EMPTY) continue;
+            Piece pc = pos.b[sq];
+            if(pc==EMPTY) continue;
+            int id = (pc-1) % 6, rel = isWhite(pc) ? sq : 63-sq;
+            float sign = isWhite(pc) ? 1.0f : -1.0f;
+            tr.add(&w.material[id], sign, 0);
+            tr.add(&w.materialEg[id], 0, sign);
+            tr.add(&w.pst[MG][id][rel], sign, 0);
+            tr.add(&w.pst[EG][id][rel], 0, sign);
+        }
+        if(evalTerms & TERM_PAWNS){
+            PawnEntry pe;
+            evalPawns(pos, w, pe, &tr);
+        }
+        if(evalTerms & TERM_ACTIVITY) evalActivity(pos, w.activity, &tr);
+        tr.take(out.terms);
+
+        if(evalTerms & TERM_MATERIAL){
+            out.imbalance = me.imbalance;
+            out.scaleW = me.scale[0];
+            out.scaleB = me.scale[1];
+            if(me.bishopsOnly && oppositeBishops(pos)){
+                out.scaleW = std::min(out.scaleW, (float)SCALE_NORMAL/2);
+                out.scaleB = std::min(out.scaleB, (float)SCALE_NORMAL/2);
+            }
+        }
+    }
 
-            auto idxPiece=[&](Piece x)->int{
-                switch(x){
-                    case WP: case BP: return 0;
-                    case WN: case BN: return 1;
-                    case WB: case BB: return 2;
-                    case WR: case BR: return 3;
-                    case WQ: case BQ: return 4;
-                    case WK: case BK: return 5;
-                    default: return 5;
-                }
-            };
+    // 子力 + PST，依遊戲階段在 MG / EG 之間內插。掛著本引擎的表就直接用增量總和；
+    // 否則（搜尋外的局面）逐格查表
+    int psqEval(const Position& pos) const{
+        int mg, eg;
+        if(pos.psqt == &w.psqt){
+            mg = pos.psqScore[0][MG] - pos.psqScore[1][MG];
+            eg = pos.psqScore[0][EG] - pos.psqScore[1][EG];
+        }else{
+            mg = eg = 0;
+            for(int sq=0;sq<64;sq++){
+                Piece pc = pos.b[sq];
+                if(pc==EMPTY) continue;
+                int sign = isWhite(pc) ? 1 : -1;
+                mg += sign * w.psqt.at(MG, pc, sq);
+                eg += sign * w.psqt.at(EG, pc, sq);
+            }
+        }
+        int ph = std::min(pos.phase, PHASE_MAX);
+        return (mg * ph + eg * (PHASE_MAX - ph)) / PHASE_MAX;
+    }
 
-            int id=idxPiece(p);
-            double s = w.material[id];
-            if(p==WP) s += w.pstPawn[sq];
-            if(p==BP) s += w.pstPawn[63-sq];
-            if(p==WN) s += w.pstKnight[sq];
-            if(p==BN) s += w.pstKnight[63-sq];
+    static const MaterialEntry& materialEntry(const Position& pos, MaterialTable* material, MaterialEntry& local){
+        if(!material){
+            evalMaterial(pos, local);
+            return local;
+        }
+        bool found;
+        MaterialEntry* e = material->probe(pos.materialKey, found);
+        if(!found) evalMaterial(pos, *e);
+        return *e;
+    }
 
-            if(isWhite(p)) score += s;
-            else score -= s;
+    template<class C>
+    int pawnScore(const C& c, const Position& pos, PawnTable* pawns) const{
+        if(!pawns){
+            PawnEntry e;
+            evalPawns(pos, c, e);
+            return e.score;
+        }
+        bool found;
+        PawnEntry* e = pawns->probe(pos.pawnKey, found);
+        if(!found) evalPawns(pos, c, *e);
+        return e->score;
+    }
+
+    // 經過 eval cache 的靜態評估，走子方視角（key 含走子方，直接存這個視角）。
+    // 給了 (alpha, beta) 就允許 lazy 提早結束；提早結束的分數只是近似，不進 eval cache
+    template<class Ev>
+    int evaluate(SearchThread& t, const Position& pos, int alpha=-INF, int beta=INF) const{
+        int sc;
+        if(t.evalCache.probe(pos.key, sc)) return sc;
+        bool white = pos.whiteToMove;
+        int tier;
+        sc = Ev::eval(*this, pos, &t.pawnTable, &t.materialTable, white ? alpha : -beta, white ? beta : -alpha, &tier);
+        if(!white) sc = -sc;
+        t.lazyExits[tier]++;
+        if(tier == LAZY_FULL) t.evalCache.store(pos.key, sc);
+        return sc;
+    }
+
+    // 搜尋以外（對局裁決）的評估：借用主執行緒的 eval cache，白方視角
+    int evalCached(const Position& pos){
+        ensureWorkers(1);
+        int sc = withEvaluator([&](auto ev){ return evaluate<decltype(ev)>(*(*workers)[0], pos); });
+        return pos.whiteToMove ? sc : -sc;
+    }
+
+    void ensureTT(){
+        if(!tt){
+            tt = std::make_shared<TranspositionTable>();
+            tt->resize(hashMB);
+        }
+    }
+
+    void ensureWorkers(int n){
+        if(!workers) workers = std::make_shared<std::vector<std::unique_ptr<SearchThread>>>();
+        while((int)workers->size() < n) workers->push_back(std::make_unique<SearchThread>());
+    }
+
+    // ucinewgame / 換權重：TT、各執行緒的 history、eval cache、pawn / material hash 一起清
+    void clearHash(){
+        if(tt) tt->clear();
+        if(workers) for(auto& t : *workers){
+            t->clearHistory();
+            t->evalCache.clear();
+            t->pawnTable.clear();
+            t->materialTable.clear();
         }
-        return (int)std::llround(score);
     }
 
     int alphabeta(Position& pos, int depth, int alpha, int beta){
-        if(depth<=0) return eval(pos) * (pos.whiteToMove ? 1 : -1);
+        ensureTT();
+        ensureWorkers(1);
+        SearchThread& t = *(*workers)[0];
+        // 上一次 bestMove / MCTS 留下的指標指向它們堆疊上的 SearchShared / YbwcPool，這裡單執行緒、不限時
+        t.sp = nullptr;
+        t.pool = nullptr;
+        t.shared = nullptr;
+        t.resetStack();
+        const PsqTable* saved = pos.psqt;
+        NnueStack* savedNnue = pos.nnue;
+        attachPsq(pos);
+        t.nnue.top = 0;
+        attachNnue(t, pos);
+        int v = withEvaluator([&](auto ev){ return search<decltype(ev), PV>(t, pos, t.stack(0), depth, alpha, beta); });
+        pos.setPsqTable(saved);
+        pos.nnue = savedNnue;
+        return v;
+    }
+
+    // 排序分數：TT 著法 > 吃子/升變（MVV-LVA）> killer > 其餘安靜著依前兩步的 continuation history
+    static constexpr int SCORE_TT       = 1<<30;
+    static constexpr int SCORE_TACTICAL = 1<<29;
+    static constexpr int SCORE_KILLER   = 1<<28;
+
+    static int mvvLva(const Position& pos, const Move& m){
+        return seeValue(m.captured)*8 - seeValue(pos.b[m.from])/100;
+    }
+
+    static void orderMoves(const Position& pos, StackEntry* ss, uint16_t ttMove){
+        MoveList& moves = ss->moves;
+        const ContHistEntry& ch1 = *(ss-1)->contHist;
+        const ContHistEntry& ch2 = *(ss-2)->contHist;
+        for(size_t i=0;i<moves.size();i++){
+            const Move& m = moves[i];
+            Piece pc = pos.b[m.from];
+            int s;
+            if(matchesPacked(m, ttMove))          s = SCORE_TT;
+            else if(isTactical(pos, m))           s = SCORE_TACTICAL + mvvLva(pos, m);
+            else if(sameMove(m, ss->killers[0]))  s = SCORE_KILLER + 1;
+            else if(sameMove(m, ss->killers[1]))  s = SCORE_KILLER;
+            else                                  s = ch1[pc][m.to] + ch2[pc][m.to];
+            ss->scores[i] = s;
+        }
+        sortMoves(moves, ss->scores);
+    }
 
-        std::vector<Move> moves;
-        pos.genLegalMoves(moves);
-        if(moves.empty()) return 0;
+    // 插入排序（穩定）：著法數很少，而且不配置記憶體
+    static void sortMoves(MoveList& moves, int* scores){
+        for(size_t i=1;i<moves.size();i++){
+            Move m = moves[i];
+            int s = scores[i];
+            size_t j = i;
+            for(; j>0 && scores[j-1]<s; j--){
+                moves[j] = moves[j-1];
+                scores[j] = scores[j-1];
+            }
+            moves[j] = m;
+            scores[j] = s;
+        }
+    }
 
-        std::stable_sort(moves.begin(), moves.end(),
-            [&](const Move& a,const Move& b){ return (a.captured!=EMPTY) > (b.captured!=EMPTY); });
+    // 記下這一層走了什麼，子節點靠 ss-1 / ss-2 取 continuation history
+    static void setCurrentMove(SearchThread& t, StackEntry* ss, const Position& pos, const Move& m){
+        ss->currentMove = m;
+        ss->movedPiece = pos.b[m.from];
+        ss->contHist = t.contHistFor(ss->movedPiece, m.to);
+    }
+
+    // 子節點的主變例接在 m 後面
+    static void updatePV(StackEntry* ss, const Move& m){
+        ss->pv[0] = m;
+        int n = std::min((ss+1)->pvLen, MAX_PLY);
+        std::copy_n((ss+1)->pv, n, ss->pv+1);
+        ss->pvLen = n+1;
+    }
 
-        for(const auto& m : moves){
+    static void updateContHist(StackEntry* ss, Piece pc, int to, int bonus){
+        for(int k=1;k<=2;k++){
+            if((ss-k)->movedPiece==EMPTY) continue;
+            int16_t& e = (*(ss-k)->contHist)[pc][to];
+            e += (int16_t)(bonus - e * std::abs(bonus) / CONT_HIST_MAX);
+        }
+    }
+
+    // 安靜著造成 beta cutoff：記成 killer、加分；在它之前搜過但沒 cutoff 的安靜著扣分
+    static void updateQuietStats(const Position& pos, StackEntry* ss, const MoveList& moves,
+                                 size_t first, size_t cut, int depth){
+        const Move& m = moves[cut];
+        if(!sameMove(m, ss->killers[0])){
+            ss->killers[1] = ss->killers[0];
+            ss->killers[0] = m;
+        }
+        int bonus = std::min(depth*depth, 400) * 8;
+        updateContHist(ss, pos.b[m.from], m.to, bonus);
+        for(size_t i=first;i<cut;i++)
+            if(!isTactical(pos, moves[i])) updateContHist(ss, pos.b[moves[i].from], moves[i].to, -bonus);
+    }
+
+    // Root / PV 節點（視窗 > 1）少數但要精確；NonPV 節點是零視窗，佔絕大多數。
+    // 以模板展開，NonPV 版本編譯時就沒有 PV 專屬的分支與記帳。
+    template<class Ev, NodeType NT>
+    int search(SearchThread& t, Position& pos, StackEntry* ss, int depth, int alpha, int beta) const{
+        constexpr bool PvNode = NT != NonPV;
+        constexpr bool RootNode = NT == Root;
+        const int ply = ss->ply;
+
+        if(t.aborted()) return 0;
+        t.nodes++;
+        t.pollTime();
+        if constexpr(PvNode) ss->pvLen = 0;
+
+        if(ply>=MAX_PLY) return evaluate<Ev>(t, pos);
+        if(depth<=0){
+            return pos.isInCheck(pos.whiteToMove) ? qsearch<Ev, true>(t, pos, ss, alpha, beta)
+                                                  : qsearch<Ev, false>(t, pos, ss, alpha, beta);
+        }
+
+        // Mate distance pruning：就算這裡立刻殺/被殺，也不會比已知更短的殺棋好
+        if constexpr(!RootNode){
+            alpha = std::max(alpha, matedIn(ply));
+            beta  = std::min(beta, mateIn(ply+1));
+            if(alpha >= beta) return alpha;
+        }
+
+        // PV 節點不吃 TT cutoff，保留完整主變例
+        TTData tte;
+        uint16_t ttMove = 0;
+        if(tt->probe(pos.key, tte)){
+            ttMove = tte.move;
+            int ttScore = scoreFromTT(tte.score, ply);
+            if(!PvNode && tte.depth >= depth){
+                if(tte.bound==BOUND_EXACT) return std::max(alpha, std::min(beta, ttScore));
+                if(tte.bound==BOUND_LOWER && ttScore>=beta) return beta;
+                if(tte.bound==BOUND_UPPER && ttScore<=alpha) return alpha;
+            }
+        }
+
+        // 殘局庫：子數夠少就直接定勝和負（DTM 只在根節點用），深度給足存進 TT
+        if constexpr(!RootNode){
+            int wdl;
+            if(tablebases && probeWdl(pos, wdl)){
+                t.tbHits++;
+                int v = wdl > 0 ? TB_WIN - ply : wdl < 0 ? -TB_WIN + ply : 0;
+                TTData d;
+                d.move  = ttMove;
+                d.score = scoreToTT(v, ply);
+                d.depth = (int8_t)std::min(depth + 6, MAX_DEPTH);
+                d.bound = BOUND_EXACT;
+                tt->store(pos.key, d);
+                return v;
+            }
+        }
+
+        // 根節點的著法清單由 bestMove 維護（MultiPV 排除、上一輪排序）
+        MoveList& moves = RootNode ? *t.rootMoves : ss->moves;
+        size_t first = RootNode ? (size_t)t.pvIdx : 0;
+        bool inCheck = pos.isInCheck(pos.whiteToMove);
+        if constexpr(!RootNode){
+            pos.genLegalMoves(moves);
+            if(moves.empty()) return inCheck ? matedIn(ply) : 0;
+        }
+        ss->staticEval = inCheck ? -INF : evaluate<Ev>(t, pos);
+
+        // ProbCut：有一步 SEE 夠好的吃子，淺搜就已經超過 beta+margin，整個節點大概率 fail-high
+        if constexpr(!PvNode){
+            if(depth>=PROBCUT_MIN_DEPTH && !inCheck && std::abs(beta) < MATE_BOUND){
+                int pcBeta = beta + PROBCUT_MARGIN;
+                for(const Move& m : moves){
+                    if(!isTactical(pos, m) || see(pos, m) < pcBeta - ss->staticEval) continue;
+
+                    setCurrentMove(t, ss, pos, m);
+                    Undo u;
+                    pos.makeMove(m,u);
+                    bool givesCheck = pos.isInCheck(pos.whiteToMove);
+                    int val = givesCheck ? -qsearch<Ev, true>(t, pos, ss+1, -pcBeta, -pcBeta+1)
+                                         : -qsearch<Ev, false>(t, pos, ss+1, -pcBeta, -pcBeta+1);
+                    if(val >= pcBeta)
+                        val = -search<Ev, NonPV>(t, pos, ss+1, depth-PROBCUT_REDUCTION, -pcBeta, -pcBeta+1);
+                    pos.unmakeMove(m,u);
+                    if(t.aborted()) return 0;
+
+                    if(val >= pcBeta){
+                        TTData d;
+                        d.move  = packMove(m);
+                        d.score = scoreToTT(val, ply);
+                        d.depth = (int8_t)(depth-PROBCUT_REDUCTION+1);
+                        d.bound = BOUND_LOWER;
+                        tt->store(pos.key, d);
+                        return beta;
+                    }
+                }
+            }
+        }
+
+        // Internal iterative reduction：沒有 TT 著法代表排序很差，少搜一層換來下一輪的 TT 著法
+        if(!RootNode && !ttMove && depth>=IIR_MIN_DEPTH) depth--;
+
+        if constexpr(!RootNode) orderMoves(pos, ss, ttMove);
+
+        int origAlpha = alpha;
+        Move best = RootNode ? moves[first] : Move{};
+
+        for(size_t i=first;i<moves.size();i++){
+            if(canSplit(t, i-first, depth)){
+                alpha = splitNode<Ev>(t, pos, ss, moves, i, depth, alpha, beta, PvNode, &best);
+                break;
+            }
+
+            // PVS：長子用完整視窗，其餘先用零視窗證明不會更好，失敗才重搜
+            const Move& m = moves[i];
+            setCurrentMove(t, ss, pos, m);
+            if constexpr(PvNode) (ss+1)->pvLen = 0;
             Undo u;
             pos.makeMove(m,u);
-            int val = -alphabeta(pos, depth-1, -beta, -alpha);
+            int val;
+            if(!PvNode || i==first){
+                val = PvNode ? -search<Ev, PV>(t, pos, ss+1, depth-1, -beta, -alpha)
+                             : -search<Ev, NonPV>(t, pos, ss+1, depth-1, -beta, -alpha);
+            }else{
+                val = -search<Ev, NonPV>(t, pos, ss+1, depth-1, -alpha-1, -alpha);
+                if(val>alpha && val<beta && !t.aborted())
+                    val = -search<Ev, PV>(t, pos, ss+1, depth-1, -beta, -alpha);
+            }
+            pos.unmakeMove(m,u);
+            if(t.aborted()) break;
+
+            if(val>=beta){
+                alpha=beta;
+                best=m;
+                if(!isTactical(pos, m)) updateQuietStats(pos, ss, moves, first, i, depth);
+                break;
+            }
+            if(val>alpha){
+                alpha=val;
+                best=m;
+                if constexpr(PvNode) updatePV(ss, m);
+                if(RootNode && alpha >= t.shared->mateTarget) break;
+            }
+        }
+
+        if constexpr(RootNode) t.rootBest = best;
+
+        // 被叫停 / 被 cutoff 的子樹分數不可信，不寫進 TT
+        if(t.aborted()) return 0;
+
+        TTData d;
+        d.move  = packMove(best);
+        d.score = scoreToTT(alpha, ply);
+        d.depth = (int8_t)std::min(depth, 127);
+        d.bound = alpha>=beta ? BOUND_LOWER : alpha>origAlpha ? BOUND_EXACT : BOUND_UPPER;
+        tt->store(pos.key, d);
+        return alpha;
+    }
+
+    // 靜態搜尋：只搜吃子/升變直到局面安靜，SEE 明顯虧的吃子不搜。
+    // 被將軍時不能 stand pat，要搜所有解將著（沒有就是被將死）；以模板分開兩種情況。
+    template<class Ev, bool InCheck>
+    int qsearch(SearchThread& t, Position& pos, StackEntry* ss, int alpha, int beta) const{
+        if(t.aborted()) return 0;
+        t.nodes++;
+        t.pollTime();
+
+        const int ply = ss->ply;
+        if(ply>=MAX_PLY) return evaluate<Ev>(t, pos);
+
+        MoveList& moves = ss->moves;
+        if constexpr(InCheck){
+            ss->staticEval = -INF;
+            alpha = std::max(alpha, matedIn(ply));
+            if(alpha >= beta) return alpha;
+            pos.genLegalMoves(moves);
+            if(moves.empty()) return matedIn(ply);
+        }else{
+            int standPat = evaluate<Ev>(t, pos, alpha, beta);
+            ss->staticEval = standPat;
+            if(standPat>=beta) return beta;
+            if(standPat>alpha) alpha=standPat;
+
+            pos.genPseudoLegalMoves(moves);
+            size_t n = 0;
+            for(size_t i=0;i<moves.size();i++)
+                if(isTactical(pos, moves[i])) moves[n++] = moves[i];
+            moves.resize(n);
+        }
+
+        // MVV-LVA：先吃大子、用小子吃
+        for(size_t i=0;i<moves.size();i++) ss->scores[i] = mvvLva(pos, moves[i]);
+        sortMoves(moves, ss->scores);
+
+        bool us = pos.whiteToMove;
+        for(const Move& m : moves){
+            if(!InCheck && m.promo==EMPTY && see(pos, m) < 0) continue;
+
+            Undo u;
+            pos.makeMove(m,u);
+            if(!InCheck && pos.isInCheck(us)){ pos.unmakeMove(m,u); continue; }
+            int val = pos.isInCheck(pos.whiteToMove) ? -qsearch<Ev, true>(t, pos, ss+1, -beta, -alpha)
+                                                     : -qsearch<Ev, false>(t, pos, ss+1, -beta, -alpha);
             pos.unmakeMove(m,u);
+
             if(val>=beta) return beta;
             if(val>alpha) alpha=val;
         }
         return alpha;
     }
 
-    Move bestMove(const Position& pos, int depth, double epsilon=0.0, std::mt19937* rng=nullptr){
+    // 長子已搜完、深度夠、而且真的有人閒著才分裂
+    bool canSplit(const SearchThread& t, size_t moveIdx, int depth) const{
+        return t.pool && moveIdx>0 && depth>=splitMinDepth && t.pool->idle>0;
+    }
+
+    // 在 pos 建立分裂點，從 moves[first] 開始與 helper 分工；回傳 fail-hard 分數
+    template<class Ev>
+    int splitNode(SearchThread& t, Position& pos, StackEntry* ss, const MoveList& moves, size_t first,
+                  int depth, int alpha, int beta, bool pvNode, Move* bestOut) const{
+        YbwcPool& pool = *t.pool;
+        SplitPoint sp;
+        sp.parent = t.sp;
+        sp.pos = pos;
+        sp.moves = &moves;
+        sp.next = first;
+        sp.depth = depth;
+        sp.ply = ss->ply;
+        sp.pvNode = pvNode;
+        sp.prevMove = (ss-1)->currentMove;
+        sp.prevPiece = (ss-1)->movedPiece;
+        sp.alpha = alpha;
+        sp.beta = beta;
+        if(bestOut){ sp.best = *bestOut; sp.hasBest = true; }
+        if(pvNode){
+            sp.pvLen = ss->pvLen;
+            std::copy_n(ss->pv, ss->pvLen, sp.pv);
+        }
+
+        {
+            std::lock_guard<std::mutex> lk(pool.m);
+            pool.active.push_back(&sp);
+        }
+        pool.cv.notify_all();
+
+        workAt<Ev>(t, sp, &pos);
+
+        // 先下架（不再有人加入），再等還在裡面的 helper 離開，sp 才能出 scope
+        {
+            std::unique_lock<std::mutex> lk(pool.m);
+            pool.active.erase(std::find(pool.active.begin(), pool.active.end(), &sp));
+            pool.cv.wait(lk, [&]{ return sp.workers==0; });
+        }
+
+        if(bestOut && sp.hasBest) *bestOut = sp.best;
+        if(pvNode){
+            ss->pvLen = sp.pvLen;
+            std::copy_n(sp.pv, sp.pvLen, ss->pv);
+        }
+        return sp.cutoff ? beta : sp.alpha;
+    }
+
+    // 從分裂點逐一領取兄弟節點來搜；helper 傳 nullptr，用分裂點局面的副本，
+    // 並在自己的堆疊上補回分裂節點的前一步（子節點的 ss-2 要用）
+    template<class Ev>
+    void workAt(SearchThread& t, SplitPoint& sp, Position* own) const{
+        SplitPoint* saved = t.sp;
+        t.sp = &sp;
+
+        Position local;
+        Position* p = own;
+        StackEntry* ss = t.stack(sp.ply);
+        int nnueTop = t.nnue.top;
+        if(!p){
+            local = sp.pos;
+            p = &local;
+            attachNnue(t, local);
+            (ss-1)->currentMove = sp.prevMove;
+            (ss-1)->movedPiece = sp.prevPiece;
+            (ss-1)->contHist = t.contHistFor(sp.prevPiece, sp.prevMove.to);
+        }
+
+        while(true){
+            Move m;
+            int a, b;
+            {
+                std::lock_guard<std::mutex> lk(sp.m);
+                if(sp.cutoff || sp.next >= sp.moves->size()) break;
+                m = (*sp.moves)[sp.next++];
+                a = sp.alpha;
+                b = sp.beta;
+            }
+
+            setCurrentMove(t, ss, *p, m);
+            (ss+1)->pvLen = 0;
+            Undo u;
+            p->makeMove(m,u);
+            int val = -search<Ev, NonPV>(t, *p, ss+1, sp.depth-1, -a-1, -a);
+            if(sp.pvNode && val>a && val<b && !t.aborted())
+                val = -search<Ev, PV>(t, *p, ss+1, sp.depth-1, -b, -a);
+            p->unmakeMove(m,u);
+            if(t.aborted()) break;
+
+            std::lock_guard<std::mutex> lk(sp.m);
+            if(val > sp.alpha){
+                sp.alpha = val;
+                sp.best = m;
+                sp.hasBest = true;
+                if(val >= sp.beta) sp.cutoff = true;
+                else if(sp.pvNode){
+                    sp.pv[0] = m;
+                    sp.pvLen = std::min((ss+1)->pvLen, MAX_PLY) + 1;
+                    std::copy_n((ss+1)->pv, sp.pvLen-1, sp.pv+1);
+                }
+            }
+        }
+
+        t.nnue.top = nnueTop;
+        t.sp = saved;
+    }
+
+    // helper 執行緒：閒置時等分裂點出現，偷完兄弟節點再回來等
+    template<class Ev>
+    void idleLoop(YbwcPool& pool, SearchThread& t) const{
+        std::unique_lock<std::mutex> lk(pool.m);
+        while(true){
+            SplitPoint* sp=nullptr;
+            pool.idle++;
+            pool.cv.wait(lk, [&]{ return pool.quit || (sp=pool.pickSplit())!=nullptr; });
+            pool.idle--;
+            if(pool.quit) return;
+
+            sp->workers++;
+            lk.unlock();
+            workAt<Ev>(t, *sp, nullptr);
+            lk.lock();
+            sp->workers--;
+            pool.cv.notify_all();
+        }
+    }
+
+    // nodes>0：固定節點數搜尋（depth 仍是上限，可傳 0 表示不限深度）
+    Move bestMove(const Position& pos, int depth, double epsilon=0.0, std::mt19937* rng=nullptr, uint64_t nodes=0){
+        SearchLimits lim;
+        lim.depth = (depth<=0 && !nodes) ? 1 : depth;
+        lim.nodes = nodes;
+        return bestMove(pos, lim, epsilon, rng);
+    }
+
+    Move bestMove(const Position& pos, const SearchLimits& lim, double epsilon=0.0, std::mt19937* rng=nullptr){
+        return withEvaluator([&](auto ev){ return searchRoot<decltype(ev)>(pos, lim, epsilon, rng); });
+    }
+
+    // 迭代加深：每輪把上一輪的最佳著放最前面；被叫停的那一輪結果不採用
+    // MultiPV：同一輪依序搜 K 個 slot，第 k 個 slot 排除前面 slot 已選的根著法，TT 共用
+    template<class Ev>
+    Move searchRoot(const Position& pos, const SearchLimits& lim, double epsilon, std::mt19937* rng){
         Position p = pos;
+        lastNodes = 0;
+        lastPV.clear();
 
-        std::vector<Move> moves;
+        MoveList moves;
         p.genLegalMoves(moves);
         if(moves.empty()) return Move{};
 
@@ -685,24 +2493,130 @@ struct Engine {
             }
         }
 
-        int bestScore=-1000000000;
-        Move best=moves[0];
-
-        for(const auto& m : moves){
-            Position p2 = pos;
-            Undo u;
-            p2.makeMove(m, u);
-
-            // 用 alphabeta 看 depth-1
-            int sc = -alphabeta(p2, depth - 1, -1000000000, 1000000000);
+        filterRootMoves(p, moves);
+        ensureTT();
+        attachPsq(p);
+
+        SearchShared shared;
+        shared.tm.init(lim, p.whiteToMove, moveOverhead);
+        shared.control = control;
+
+        // helper 執行緒只活在這次搜尋裡；堆疊與 history 則跨搜尋重複使用
+        YbwcPool pool;
+        int nHelpers = (parallel==PAR_YBWC) ? std::max(0, threads-1) : 0;
+        shared.nodeLimit = lim.nodes;
+        shared.singleThread = (nHelpers == 0);
+        ensureWorkers(nHelpers+1);
+        std::vector<SearchThread*> ctx(nHelpers+1);
+        std::vector<std::thread> helpers;
+        for(int i=0;i<=nHelpers;i++){
+            ctx[i] = (*workers)[i].get();
+            ctx[i]->id = i;
+            ctx[i]->nodes = 0;
+            ctx[i]->sp = nullptr;
+            ctx[i]->pool = nHelpers ? &pool : nullptr;
+            ctx[i]->shared = &shared;
+            ctx[i]->resetStack();
+            ctx[i]->evalCache.resetStats();
+            ctx[i]->pawnTable.resetStats();
+            ctx[i]->materialTable.resetStats();
+            ctx[i]->nnue.top = 0;
+            std::fill(std::begin(ctx[i]->lazyExits), std::end(ctx[i]->lazyExits), 0);
+            ctx[i]->tbHits = 0;
+        }
+        pool.active.reserve((size_t)MAX_PLY * (nHelpers+1));
+        for(int i=1;i<=nHelpers;i++)
+            helpers.emplace_back([this,&pool,&ctx,i]{ idleLoop<Ev>(pool, *ctx[i]); });
+
+        SearchThread& master = *ctx[0];
+        attachNnue(master, p);
+        int maxDepth = lim.depth>0 ? std::min(lim.depth, MAX_DEPTH) : MAX_DEPTH;
+        int nPV = std::min<int>(std::max(1, multiPV), (int)moves.size());
+        std::vector<int> slotScore(nPV, 0);
+        std::vector<std::vector<Move>> slotPV(nPV);
+        Move best = moves[0];
+        int stableIters = 0;
+
+        // go mate N：根節點分數一旦證明 N 步內殺（2N-1 ply）就收手
+        shared.mateTarget = lim.mate>0 ? mateIn(2*lim.mate-1) : INF;
+        bool mateFound = false;
+        master.rootMoves = &moves;
+        StackEntry* rootSS = master.stack(0);
+
+        for(int d=1; d<=maxDepth; d++){
+            for(int pvIdx=0; pvIdx<nPV && !shared.stop && !mateFound; pvIdx++){
+                master.pvIdx = pvIdx;
+                int alpha = search<Ev, Root>(master, p, rootSS, d, -INF, INF);
+                if(shared.stop) break;
+                mateFound = alpha >= shared.mateTarget;
+                Move slotBest = master.rootBest;
+
+                // 這個 slot 的最佳著換到 pvIdx（其餘相對順序不變），之後的 slot 從 pvIdx+1 開始搜
+                auto it = std::find_if(moves.begin()+pvIdx, moves.end(),
+                                       [&](const Move& m){ return sameMove(m, slotBest); });
+                std::rotate(moves.begin()+pvIdx, it, it+1);
+                slotScore[pvIdx] = alpha;
+                if(rootSS->pvLen && sameMove(rootSS->pv[0], slotBest))
+                    slotPV[pvIdx].assign(rootSS->pv, rootSS->pv + rootSS->pvLen);
+                else
+                    slotPV[pvIdx].assign(1, slotBest);
+            }
+            if(shared.stop) break;
+
+            stableIters = sameMove(moves[0], best) ? stableIters+1 : 0;
+            best = moves[0];
+            shared.canStop = true;
+            lastPV = slotPV[0];
+
+            if(onIter){
+                SearchInfo info;
+                info.depth = d;
+                for(const SearchThread* c : ctx){
+                    info.nodes += c->nodes;
+                    info.tbHits += c->tbHits;
+                }
+                info.timeMs = shared.tm.elapsed();
+                info.hashfull = tt->hashfull();
+                for(int k=0;k<(mateFound ? 1 : nPV);k++){
+                    info.multipv = k+1;
+                    info.score = slotScore[k];
+                    info.best = moves[k];
+                    info.pv = slotPV[k];
+                    onIter(info);
+                }
+            }
 
-            p2.unmakeMove(m, u);
+            if(mateFound) break;
+            if(control && control->stop) break;
+            if(!shared.pondering() && shared.tm.softStop(stableIters)) break;
+        }
 
-            if(sc>bestScore){
-                bestScore=sc;
-                best=m;
+        if(nHelpers){
+            {
+                std::lock_guard<std::mutex> lk(pool.m);
+                pool.quit = true;
             }
+            pool.cv.notify_all();
+            for(auto& th : helpers) th.join();
+        }
+
+        lastEvalProbes = lastEvalHits = 0;
+        lastPawnProbes = lastPawnHits = 0;
+        lastMaterialProbes = lastMaterialHits = 0;
+        std::fill(std::begin(lastLazy), std::end(lastLazy), 0);
+        lastTbHits = 0;
+        for(const SearchThread* c : ctx){
+            lastTbHits += c->tbHits;
+            for(int k=0;k<3;k++) lastLazy[k] += c->lazyExits[k];
+            lastNodes += c->nodes;
+            lastEvalProbes += c->evalCache.probes;
+            lastEvalHits += c->evalCache.hits;
+            lastPawnProbes += c->pawnTable.probes;
+            lastPawnHits += c->pawnTable.hits;
+            lastMaterialProbes += c->materialTable.probes;
+            lastMaterialHits += c->materialTable.hits;
         }
+        if(lastPV.empty()) lastPV.push_back(best);
         return best;
     }
 };
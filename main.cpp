@@ -1,6 +1,9 @@
 #include "engine_real.hpp"
+#include "dfpn.hpp"
+#include "mcts.hpp"
 #include <iostream>
 #include <sstream>
+#include <fstream>
 #include <vector>
 #include <chrono>
 #include <iomanip>
@@ -9,6 +12,8 @@
 #include <random>
 #include <cstdlib>
 #include <algorithm>
+#include <mutex>
+#include <thread>
 
 // ============================
 // 小工具：座標轉換
@@ -103,12 +108,32 @@ static std::string moveToUci(const Move& m){
     return moveToUciLocal(m);
 }
 
+// ============================
+// 啟動時的權重
+// ============================
+// 建置時編進執行檔的權重優先（CHESS_EMBED_WEIGHTS，不受工作目錄影響）；沒有編進去才讀工作目錄的 weights.txt
+static Weights startupWeights() {
+    Weights w = Weights::builtin();
+    if (!Weights::HAS_EMBEDDED) w.load("weights.txt");
+    return w;
+}
+
+static std::string weightsSource() {
+#ifdef CHESS_EMBEDDED_WEIGHTS
+    return std::string("embedded ") + EMBEDDED_WEIGHTS_FILE;
+#else
+    return "weights.txt";
+#endif
+}
+
 // ============================
 // Bench：自動對戰測試
 // ============================
-static int playGameBench(Engine& white, Engine& black, int depth, int maxPlies, std::mt19937& rng) {
+// nodes>0 時改用固定節點數（depth 傳 0）：每步成本一致，單執行緒結果可重現
+static int playGameBench(Engine& white, Engine& black, int depth, uint64_t nodes, int maxPlies, std::mt19937& rng) {
     Position pos;
     pos.setStartPos();
+    white.attachPsq(pos);   // 每步裁決用白方的 eval：子力 + PST 增量維護，不必每步掃盤面
 
     const int RANDOM_OPENING_PLIES = 8;
     double eps = 0.10;
@@ -118,6 +143,8 @@ static int playGameBench(Engine& white, Engine& black, int depth, int maxPlies,
         pos.genLegalMoves(moves);
 
         if (moves.empty()) {
+            // 被將死才算輸，逼和是和局
+            if (!pos.isInCheck(pos.whiteToMove)) return 0;
             return pos.whiteToMove ? -1 : +1;
         }
 
@@ -127,13 +154,13 @@ static int playGameBench(Engine& white, Engine& black, int depth, int maxPlies,
             m = moves[I(rng)];
         } else {
             Engine& side = pos.whiteToMove ? white : black;
-            m = side.bestMove(pos, depth, eps, &rng);
+            m = side.bestMove(pos, nodes ? 0 : depth, eps, &rng, nodes);
         }
 
         Undo u;
         pos.makeMove(m, u);
 
-        int sc = white.eval(pos);
+        int sc = white.evalCached(pos);
 
         if (sc > 600) return +1;
         if (sc < -600) return -1;
@@ -141,24 +168,23 @@ static int playGameBench(Engine& white, Engine& black, int depth, int maxPlies,
         eps *= 0.997;
     }
 
-    int sc = white.eval(pos);
+    int sc = white.evalCached(pos);
     if (sc > 80) return +1;
     if (sc < -80) return -1;
     return 0;
 }
 
-static void runBench(int games, int depth) {
+static void runBench(int games, int depth, uint64_t nodes) {
     Engine A, B;
 
-    A.w = Weights::defaultWeights();
-    A.w.load("weights.txt");           // 訓練後權重
+    A.w = startupWeights();            // 訓練後權重
 
     B.w = Weights::defaultWeights();   // baseline
 
     std::cout << "[DBG] A material0=" << A.w.material[0]
               << " B material0=" << B.w.material[0] << "\n";
-    std::cout << "[DBG] A pawnPST0=" << A.w.pstPawn[0]
-              << " B pawnPST0=" << B.w.pstPawn[0] << "\n";
+    std::cout << "[DBG] A pawnPST0=" << A.w.pst[MG][0][0]
+              << " B pawnPST0=" << B.w.pst[MG][0][0] << "\n";
     std::cout.flush();
 
     int win = 0, draw = 0, loss = 0;
@@ -170,8 +196,8 @@ static void runBench(int games, int depth) {
         bool AisWhite = (i % 2 == 0);
 
         int res = AisWhite
-            ? playGameBench(A, B, depth, 220, rng)
-            : playGameBench(B, A, depth, 220, rng);
+            ? playGameBench(A, B, depth, nodes, 220, rng)
+            : playGameBench(B, A, depth, nodes, 220, rng);
 
         if (res == 0) draw++;
         else if ((res == +1 && AisWhite) || (res == -1 && !AisWhite)) win++;
@@ -193,16 +219,449 @@ static void runBench(int games, int depth) {
 
     std::cout << "\n=== BENCH DONE ===\n";
     std::cout << "Games : " << games << "\n";
-    std::cout << "Depth : " << depth << "\n";
+    if (nodes) std::cout << "Nodes : " << nodes << " per move\n";
+    else       std::cout << "Depth : " << depth << "\n";
     std::cout << "W/D/L : " << win << "/" << draw << "/" << loss << "\n";
     std::cout << "Score : " << std::fixed << std::setprecision(4) << score << "\n";
     std::cout << "Time  : " << sec << " sec\n";
     std::cout.flush();
 }
 
+// ============================
+// 固定局面集：搜尋速度 / 平行效率量測用
+// ============================
+static const char* BENCH_FENS[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4",
+    "r2q1rk1/pp2bppp/2n1pn2/3p4/2PP4/2N1PN2/PP3PPP/R2QKB1R w KQ - 0 9",
+    "rnbqkb1r/pp1p1ppp/4pn2/2p5/2PP4/2N5/PP2PPPP/R1BQKBNR w KQkq - 0 4",
+    "r1bq1rk1/ppp2ppp/2np1n2/2b1p3/2B1P3/2NP1N2/PPP2PPP/R1BQ1RK1 w - - 0 7",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1",
+};
+
+// ============================
+// Speed：單執行緒固定深度搜完整個局面集，回報 nodes / nps（搜尋改動前後對照用）
+// 給了 NNUE 檔就用 NNUE 評估，同一個執行檔可以對照兩種評估器
+// ============================
+static void runSpeed(int depth, const std::string& netFile) {
+    Engine e;
+    e.w = startupWeights();
+    if (!netFile.empty() && !e.loadNet(netFile))
+        std::cerr << "[WARN] cannot load NNUE file " << netFile << ", using " << e.evaluatorName() << "\n";
+
+    uint64_t totalNodes = 0;
+    uint64_t evalProbes = 0, evalHits = 0;
+    uint64_t pawnProbes = 0, pawnHits = 0;
+    uint64_t matProbes = 0, matHits = 0;
+    uint64_t lazy[3] = {};
+    double totalSec = 0;
+
+    for (const char* fen : BENCH_FENS) {
+        Position pos;
+        pos.setFEN(fen);
+        e.clearHash();
+
+        auto t0 = std::chrono::high_resolution_clock::now();
+        Move bm = e.bestMove(pos, depth);
+        auto t1 = std::chrono::high_resolution_clock::now();
+        double sec = std::chrono::duration<double>(t1 - t0).count();
+
+        totalNodes += e.lastNodes;
+        evalProbes += e.lastEvalProbes;
+        evalHits += e.lastEvalHits;
+        pawnProbes += e.lastPawnProbes;
+        pawnHits += e.lastPawnHits;
+        matProbes += e.lastMaterialProbes;
+        matHits += e.lastMaterialHits;
+        for (int k = 0; k < 3; k++) lazy[k] += e.lastLazy[k];
+        totalSec += sec;
+        std::cout << "[speed] best=" << moveToUci(bm)
+                  << " nodes=" << e.lastNodes
+                  << " time=" << std::fixed << std::setprecision(3) << sec << "\n";
+        std::cout.flush();
+    }
+
+    std::cout << "\n=== SPEED DONE ===\n";
+    std::cout << "Depth : " << depth << "\n";
+    std::cout << "Eval  : " << e.evaluatorName() << "\n";
+    std::cout << "Nodes : " << totalNodes << "\n";
+    std::cout << "Time  : " << std::fixed << std::setprecision(3) << totalSec << " sec\n";
+    std::cout << "NPS   : " << (uint64_t)(totalNodes / std::max(totalSec, 1e-9)) << "\n";
+    std::cout << "EvalHit : " << std::setprecision(1) << 100.0 * evalHits / std::max<uint64_t>(evalProbes, 1)
+              << "% (" << evalHits << "/" << evalProbes << ")\n";
+    std::cout << "PawnHit : " << 100.0 * pawnHits / std::max<uint64_t>(pawnProbes, 1)
+              << "% (" << pawnHits << "/" << pawnProbes << ")\n";
+    std::cout << "MatHit  : " << 100.0 * matHits / std::max<uint64_t>(matProbes, 1)
+              << "% (" << matHits << "/" << matProbes << ")\n";
+    uint64_t evals = std::max<uint64_t>(lazy[0] + lazy[1] + lazy[2], 1);
+    std::cout << "Lazy    : psq " << 100.0 * lazy[LAZY_PSQ] / evals << "%  hash " << 100.0 * lazy[LAZY_HASH] / evals
+              << "%  full " << 100.0 * lazy[LAZY_FULL] / evals << "% (" << evals << " evals)\n";
+    std::cout.flush();
+}
+
+// ============================
+// Evalcost：每個評估項的成本
+// ============================
+// 1) 搜尋：關掉單一項重跑 speed 局面集，nps 上升多少就是那一項的成本（樹形狀會變，節點數僅供參考）
+// 2) 單獨：局面集展開兩層的所有局面，不經任何快取逐項計時，扣掉只開子力 + PST 的基準
+static void runEvalCost(int depth) {
+    Weights wt = startupWeights();
+
+    struct Mode { const char* name; unsigned terms; };
+    const Mode modes[] = {
+        { "all",       TERM_ALL },
+        { "-material", TERM_ALL & ~TERM_MATERIAL },
+        { "-pawns",    TERM_ALL & ~TERM_PAWNS },
+        { "-activity", TERM_ALL & ~TERM_ACTIVITY },
+        { "psq-only",  0 },
+    };
+    const int nModes = (int)(sizeof(modes) / sizeof(modes[0]));
+
+    double nps[nModes] = {};
+    for (int k = 0; k < nModes; k++) {
+        Engine e;
+        e.w = wt;
+        e.evalTerms = modes[k].terms;
+        uint64_t nodes = 0;
+        double sec = 0;
+        for (const char* fen : BENCH_FENS) {
+            Position pos;
+            pos.setFEN(fen);
+            e.clearHash();
+            auto t0 = std::chrono::high_resolution_clock::now();
+            e.bestMove(pos, depth);
+            auto t1 = std::chrono::high_resolution_clock::now();
+            sec += std::chrono::duration<double>(t1 - t0).count();
+            nodes += e.lastNodes;
+        }
+        nps[k] = nodes / std::max(sec, 1e-9);
+        std::cout << "[evalcost] search " << std::left << std::setw(10) << modes[k].name
+                  << " nodes=" << nodes << " time=" << std::fixed << std::setprecision(3) << sec
+                  << " nps=" << (uint64_t)nps[k] << "\n";
+        std::cout.flush();
+    }
+
+    Engine e;
+    e.w = wt;
+    std::vector<Position> sample;
+    for (const char* fen : BENCH_FENS) {
+        Position root;
+        root.setFEN(fen);
+        e.attachPsq(root);
+        MoveList ms;
+        root.genLegalMoves(ms);
+        for (const Move& m : ms) {
+            Undo u;
+            root.makeMove(m, u);
+            MoveList replies;
+            root.genLegalMoves(replies);
+            for (const Move& r : replies) {
+                Undo u2;
+                root.makeMove(r, u2);
+                sample.push_back(root);
+                root.unmakeMove(r, u2);
+            }
+            root.unmakeMove(m, u);
+        }
+    }
+
+    const int REPEAT = 20;
+    double ns[nModes] = {};
+    volatile int sink = 0;
+    for (int k = 0; k < nModes; k++) {
+        e.evalTerms = modes[k].terms;
+        auto t0 = std::chrono::high_resolution_clock::now();
+        for (int rep = 0; rep < REPEAT; rep++)
+            for (const Position& pos : sample) sink = sink + e.eval(pos);
+        auto t1 = std::chrono::high_resolution_clock::now();
+        ns[k] = std::chrono::duration<double, std::nano>(t1 - t0).count() / (double(REPEAT) * sample.size());
+    }
+
+    std::cout << "\n=== EVALCOST DONE ===\n";
+    std::cout << "Depth     : " << depth << "\n";
+    std::cout << "Positions : " << sample.size() << " (uncached eval)\n";
+    std::cout << std::left << std::setw(10) << "term" << std::right << std::setw(12) << "nps" << std::setw(12) << "nps cost"
+              << std::setw(12) << "ns/eval" << std::setw(12) << "term ns" << "\n";
+    for (int k = 0; k < nModes; k++) {
+        std::cout << std::left << std::setw(10) << modes[k].name << std::right
+                  << std::setw(12) << (uint64_t)nps[k];
+        // 「-x」那一列：關掉 x 之後快了多少、x 單獨花多少 ns
+        if (k > 0 && k < nModes - 1)
+            std::cout << std::setw(11) << std::fixed << std::setprecision(1) << 100.0 * (nps[k] / nps[0] - 1.0) << "%";
+        else
+            std::cout << std::setw(12) << "-";
+        std::cout << std::setw(12) << std::setprecision(1) << ns[k];
+        if (k > 0 && k < nModes - 1) std::cout << std::setw(12) << ns[0] - ns[k];
+        std::cout << "\n";
+    }
+    std::cout.flush();
+}
+
+// ============================
+// Parbench：單執行緒 vs YBWC 的 time-to-depth 與節點開銷
+// ============================
+static void runParBench(int depth, int threads) {
+    Weights wt = startupWeights();
+
+    struct Mode { const char* name; int threads; ParallelMode par; };
+    const Mode modes[] = {
+        { "single", 1, PAR_OFF },
+        { "ybwc",   threads, PAR_YBWC },
+    };
+
+    double secs[2] = {0, 0};
+    uint64_t nodes[2] = {0, 0};
+
+    for (int k = 0; k < 2; k++) {
+        Engine e;
+        e.w = wt;
+        e.threads = modes[k].threads;
+        e.parallel = modes[k].par;
+
+        for (const char* fen : BENCH_FENS) {
+            Position pos;
+            pos.setFEN(fen);
+
+            auto t0 = std::chrono::high_resolution_clock::now();
+            Move bm = e.bestMove(pos, depth);
+            auto t1 = std::chrono::high_resolution_clock::now();
+            double sec = std::chrono::duration<double>(t1 - t0).count();
+
+            secs[k] += sec;
+            nodes[k] += e.lastNodes;
+            std::cout << "[parbench] " << modes[k].name << " threads=" << modes[k].threads
+                      << " best=" << moveToUci(bm)
+                      << " nodes=" << e.lastNodes
+                      << " time=" << std::fixed << std::setprecision(3) << sec << "\n";
+            std::cout.flush();
+        }
+    }
+
+    std::cout << "\n=== PARBENCH DONE ===\n";
+    std::cout << "Depth    : " << depth << "\n";
+    std::cout << "Threads  : " << threads << "\n";
+    for (int k = 0; k < 2; k++) {
+        std::cout << std::left << std::setw(9) << modes[k].name << ": nodes=" << nodes[k]
+                  << " time=" << std::fixed << std::setprecision(3) << secs[k]
+                  << " nps=" << (uint64_t)(nodes[k] / std::max(secs[k], 1e-9)) << "\n";
+    }
+    std::cout << "Speedup  : " << std::setprecision(2) << secs[0] / std::max(secs[1], 1e-9) << "x\n";
+    std::cout << "Overhead : " << std::setprecision(1)
+              << 100.0 * ((double)nodes[1] / std::max<uint64_t>(nodes[0], 1) - 1.0) << "% nodes\n";
+    std::cout.flush();
+}
+
+// ============================
+// Mctsbench：MCTS 的 playouts/s 與 alpha-beta（YBWC）的 nps 隨執行緒數的擴展
+// ============================
+static void runMctsBench(uint64_t playouts, int depth, int maxThreads) {
+    Weights wt = startupWeights();
+
+    std::vector<int> counts;
+    for (int n = 1; n < maxThreads; n *= 2) counts.push_back(n);
+    counts.push_back(maxThreads);
+
+    struct Row { int threads; double mctsSec; uint64_t mctsPlayouts; double abSec; uint64_t abNodes; };
+    std::vector<Row> rows;
+    for (int n : counts) {
+        Row r{ n, 0, 0, 0, 0 };
+        Engine e;
+        e.w = wt;
+        e.threads = n;
+        e.parallel = n > 1 ? PAR_YBWC : PAR_OFF;
+        MctsSearch mcts;
+        mcts.reuseTree = false;
+
+        for (const char* fen : BENCH_FENS) {
+            Position pos;
+            pos.setFEN(fen);
+
+            SearchLimits lim;
+            lim.nodes = playouts;
+            Move bm = mcts.bestMove(e, pos, lim);
+            r.mctsSec += mcts.lastSeconds;
+            r.mctsPlayouts += mcts.lastPlayouts;
+            std::cout << "[mctsbench] mcts threads=" << n
+                      << " best=" << moveToUci(bm)
+                      << " playouts=" << mcts.lastPlayouts
+                      << " time=" << std::fixed << std::setprecision(3) << mcts.lastSeconds << "\n";
+
+            auto t0 = std::chrono::high_resolution_clock::now();
+            bm = e.bestMove(pos, depth);
+            double sec = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t0).count();
+            r.abSec += sec;
+            r.abNodes += e.lastNodes;
+            std::cout << "[mctsbench] ab   threads=" << n
+                      << " best=" << moveToUci(bm)
+                      << " nodes=" << e.lastNodes
+                      << " time=" << std::setprecision(3) << sec << "\n";
+            std::cout.flush();
+        }
+        rows.push_back(r);
+    }
+
+    std::cout << "\n=== MCTSBENCH DONE ===\n";
+    std::cout << "Playouts : " << playouts << " per position\n";
+    std::cout << "AB depth : " << depth << "\n";
+    std::cout << "Threads  playouts/s   scaling        ab nps   scaling  ab time-to-depth\n";
+    for (const Row& r : rows) {
+        double pps = r.mctsPlayouts / std::max(r.mctsSec, 1e-9);
+        double nps = r.abNodes / std::max(r.abSec, 1e-9);
+        double pps1 = rows[0].mctsPlayouts / std::max(rows[0].mctsSec, 1e-9);
+        double nps1 = rows[0].abNodes / std::max(rows[0].abSec, 1e-9);
+        std::cout << std::setw(7) << r.threads
+                  << std::setw(13) << (uint64_t)pps
+                  << std::setw(9) << std::setprecision(2) << pps / pps1 << "x"
+                  << std::setw(14) << (uint64_t)nps
+                  << std::setw(9) << nps / nps1 << "x"
+                  << std::setw(16) << rows[0].abSec / std::max(r.abSec, 1e-9) << "x\n";
+    }
+    std::cout << "Cores    : " << std::thread::hardware_concurrency() << "\n";
+    std::cout.flush();
+}
+
+// ============================
+// Tbgen：逆推產生 3 / 4 子殘局庫（目錄裡已有的表直接沿用）
+// ============================
+static int runTbGen(const std::string& dir, int threads, int pieces) {
+    tb::TableSet set;
+    uint64_t totalBytes = 0;
+    auto t0 = std::chrono::high_resolution_clock::now();
+    bool ok = tb::generateTables(set, dir, pieces, threads,
+        [&](const tb::Table& t, const tb::GenStats& st, double sec, bool generated) {
+            totalBytes += t.file.size();
+            std::cout << "[tbgen] " << std::left << std::setw(8) << t.name << std::right;
+            if (!generated) {
+                std::cout << " (existing)\n";
+                return;
+            }
+            std::cout << " entries=" << t.entries()
+                      << " win=" << st.wins << " draw=" << st.draws << " loss=" << st.losses
+                      << " invalid=" << st.invalid
+                      << " maxDTM=" << st.maxDtm << " plies"
+                      << " bytes=" << t.file.size()
+                      << " time=" << std::fixed << std::setprecision(2) << sec << "s\n";
+            std::cout.flush();
+        });
+    if (!ok) {
+        std::cerr << "tbgen: cannot write tables to " << dir << "\n";
+        return 1;
+    }
+    double sec = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t0).count();
+    std::cout << "\n=== TBGEN DONE ===\n";
+    std::cout << "Pieces  : " << set.maxPieces << "\n";
+    std::cout << "Threads : " << threads << "\n";
+    std::cout << "Size    : " << std::fixed << std::setprecision(1) << totalBytes / 1048576.0 << " MB\n";
+    std::cout << "Time    : " << std::setprecision(2) << sec << " sec\n";
+    return 0;
+}
+
+// ============================
+// Solve：df-pn 跑 EPD 殺棋題（dm N），和 alpha-beta 的 go mate N 對照
+// ============================
+static const char* dfpnStatusName(DfpnResult::Status s) {
+    return s == DfpnResult::Proven ? "mate" : s == DfpnResult::Disproven ? "nomate" : "unknown";
+}
+
+static int runSolve(const std::string& path, size_t hashMB, uint64_t nodeLimit, bool compare) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "solve: cannot open " << path << "\n";
+        return 1;
+    }
+
+    Weights wt = startupWeights();
+
+    DfpnSolver solver;
+    solver.hashMB = hashMB;
+    solver.nodeLimit = nodeLimit;
+
+    int total = 0, solved = 0, abSolved = 0;
+    uint64_t nodes = 0, abNodes = 0;
+    double secs = 0, abSecs = 0;
+    std::string line;
+    while (std::getline(in, line)) {
+        // EPD：四個 FEN 欄位 + 以 ; 結尾的 opcode，這裡只看 dm 與 id
+        std::stringstream ss(line);
+        std::string board, active, castlingStr, epStr;
+        if (!(ss >> board >> active >> castlingStr >> epStr) || board[0] == '#') continue;
+        int dm = 0;
+        std::string id, tok;
+        while (ss >> tok) {
+            if (tok == "dm") ss >> dm;
+            else if (tok == "id") { std::getline(ss, id, ';'); id.erase(0, id.find_first_not_of(" \"")); id.erase(id.find_last_not_of(" \"") + 1); }
+        }
+        if (dm <= 0) continue;
+
+        Position pos;
+        pos.setFEN(board + " " + active + " " + castlingStr + " " + epStr + " 0 1");
+        DfpnResult r = solver.solve(pos, dm);
+        total++;
+        nodes += r.nodes;
+        secs += r.seconds;
+        if (r.status == DfpnResult::Proven) solved++;
+
+        std::cout << "[solve] " << std::left << std::setw(12) << (id.empty() ? std::to_string(total) : id) << std::right
+                  << " dm=" << dm
+                  << " dfpn=" << dfpnStatusName(r.status);
+        if (r.status == DfpnResult::Proven) std::cout << " in " << (r.matePlies + 1) / 2;
+        std::cout << " nodes=" << r.nodes
+                  << " time=" << std::fixed << std::setprecision(3) << r.seconds
+                  << " hashfull=" << r.hashfull;
+        if (!r.pv.empty()) std::cout << " pv=" << moveToUci(r.pv[0]);
+
+        if (compare) {
+            Engine e;
+            e.w = wt;
+            int score = 0;
+            e.onIter = [&](const SearchInfo& info) { if (info.multipv == 1) score = info.score; };
+            SearchLimits lim;
+            lim.mate = dm;
+            if (nodeLimit) lim.nodes = nodeLimit;
+            auto t0 = std::chrono::high_resolution_clock::now();
+            e.bestMove(pos, lim);
+            double sec = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t0).count();
+            bool ok = score >= MATE_BOUND && mateMoves(score) <= dm;
+            abSolved += ok;
+            abNodes += e.lastNodes;
+            abSecs += sec;
+            std::cout << " | ab=" << (ok ? "mate" : "unknown")
+                      << " nodes=" << e.lastNodes
+                      << " time=" << std::setprecision(3) << sec;
+        }
+        std::cout << "\n";
+        std::cout.flush();
+    }
+
+    std::cout << "\n=== SOLVE DONE ===\n";
+    std::cout << "Positions : " << total << "\n";
+    std::cout << "Hash      : " << hashMB << " MB\n";
+    std::cout << "df-pn     : solved " << solved << "/" << total
+              << " nodes=" << nodes
+              << " time=" << std::fixed << std::setprecision(3) << secs
+              << " nps=" << (uint64_t)(nodes / std::max(secs, 1e-9)) << "\n";
+    if (compare) {
+        std::cout << "alphabeta : solved " << abSolved << "/" << total
+                  << " nodes=" << abNodes
+                  << " time=" << std::setprecision(3) << abSecs
+                  << " nps=" << (uint64_t)(abNodes / std::max(abSecs, 1e-9)) << "\n";
+    }
+    return 0;
+}
+
 // ============================
 // UCI 模式
 // ============================
+// 搜尋在背景執行緒跑，I/O 執行緒隨時可以回 readyok / 處理 stop；兩邊都會寫 stdout，所以整行加鎖輸出
+static std::mutex g_outMutex;
+
+static void uciOut(const std::string& s) {
+    std::lock_guard<std::mutex> lk(g_outMutex);
+    std::cout << s << "\n" << std::flush;
+}
+
 static void runUCI() {
     std::ios::sync_with_stdio(false);
     std::cin.tie(nullptr);
@@ -211,23 +670,156 @@ static void runUCI() {
     pos.setStartPos();
 
     Engine engine;
-    engine.w = Weights::defaultWeights();
-    engine.w.load("weights.txt");
+    engine.w = startupWeights();
+    engine.onIter = [](const SearchInfo& info) {
+        std::ostringstream os;
+        os << "info depth " << info.depth
+           << " multipv " << info.multipv
+           << " score ";
+        if (std::abs(info.score) >= MATE_BOUND) os << "mate " << mateMoves(info.score);
+        else                                    os << "cp " << info.score;
+        os << " nodes " << info.nodes
+           << " time " << info.timeMs
+           << " nps " << (info.nodes * 1000 / (uint64_t)std::max<int64_t>(info.timeMs, 1))
+           << " hashfull " << info.hashfull;
+        if (info.tbHits) os << " tbhits " << info.tbHits;
+        os << " pv";
+        for (const Move& m : info.pv) os << ' ' << moveToUci(m);
+        uciOut(os.str());
+    };
+
+    SearchControl control;
+    engine.control = &control;
+    std::thread searcher;
+
+    DfpnSolver solver;
+    solver.control = &control;
+
+    SearchMode searchMode = SEARCH_AB;
+    MctsSearch mcts;
+
+    // 叫停並等背景搜尋送出 bestmove；沒有在搜尋時什麼都不做
+    auto stopSearch = [&]() {
+        if (!searcher.joinable()) return;
+        control.stop = true;
+        control.ponder = false;
+        searcher.join();
+    };
 
     std::string line;
     while (std::getline(std::cin, line)) {
         if (line == "uci") {
-            std::cout << "id name MinimalCPPChessAI\n";
-            std::cout << "id author you\n";
-            std::cout << "uciok\n" << std::flush;
+            uciOut("id name MinimalCPPChessAI");
+            uciOut("id author you");
+            uciOut("option name Threads type spin default 1 min 1 max 256");
+            uciOut("option name ParallelMode type combo default YBWC var Off var YBWC");
+            uciOut("option name Move Overhead type spin default 30 min 0 max 5000");
+            uciOut("option name Hash type spin default 16 min 1 max 4096");
+            uciOut("option name MultiPV type spin default 1 min 1 max 256");
+            uciOut("option name Ponder type check default false");
+            uciOut("option name EvalFile type string default <empty>");
+            uciOut("option name WeightsFile type string default <empty>");
+            uciOut("option name TablebasePath type string default <empty>");
+            uciOut("option name MateHash type spin default 64 min 1 max 4096");
+            uciOut("option name SearchMode type combo default AlphaBeta var AlphaBeta var MCTS");
+            uciOut("option name MctsHash type spin default 128 min 2 max 16384");
+            uciOut("uciok");
         }
         else if (line == "isready") {
-            std::cout << "readyok\n" << std::flush;
+            uciOut("readyok");
+        }
+        else if (line == "stop") {
+            stopSearch();
+        }
+        else if (line == "ponderhit") {
+            // 對手真的走了我們猜的那步：從現在起照常計時（時鐘從 go 開始算）
+            control.ponder = false;
+        }
+        else if (line.rfind("setoption", 0) == 0) {
+            stopSearch();
+            // setoption name <id> value <x>
+            std::stringstream ss(line);
+            std::string tok, name, value;
+            ss >> tok;
+            std::string* cur = nullptr;
+            while (ss >> tok) {
+                if (tok == "name") { cur = &name; continue; }
+                if (tok == "value") { cur = &value; continue; }
+                if (cur) { if (!cur->empty()) *cur += ' '; *cur += tok; }
+            }
+
+            if (name == "Threads") {
+                engine.threads = std::max(1, std::atoi(value.c_str()));
+            }
+            else if (name == "ParallelMode") {
+                engine.parallel = (value == "Off") ? PAR_OFF : PAR_YBWC;
+            }
+            else if (name == "Move Overhead") {
+                engine.moveOverhead = std::max(0, std::atoi(value.c_str()));
+            }
+            else if (name == "Hash") {
+                engine.hashMB = (size_t)std::max(1, std::atoi(value.c_str()));
+                engine.tt.reset();   // 下次搜尋依新大小重新配置
+            }
+            else if (name == "MultiPV") {
+                engine.multiPV = std::max(1, std::atoi(value.c_str()));
+            }
+            else if (name == "Ponder") {
+                // GUI 只是告知會送 go ponder，引擎端不需要額外狀態
+            }
+            else if (name == "EvalFile") {
+                // 空值 / <empty> = 用 weights.txt 的 PST 評估
+                mcts.clear();
+                if (!engine.loadNet(value))
+                    uciOut("info string [WARN] cannot load NNUE file " + value + ", keeping current eval");
+                else
+                    uciOut(std::string("info string eval ") + (engine.net ? "NNUE " + value : "PST"));
+            }
+            else if (name == "WeightsFile") {
+                // 空值 / <empty> = 回到啟動時的權重（編進執行檔的那組或 weights.txt）；載入失敗保留目前權重
+                Weights nw = Weights::defaultWeights();
+                if (value.empty() || value == "<empty>") {
+                    engine.setWeights(startupWeights());
+                    uciOut("info string weights " + weightsSource());
+                }
+                else if (!nw.load(value))
+                    uciOut("info string [WARN] cannot load weights file " + value + ", keeping current weights");
+                else {
+                    engine.setWeights(nw);
+                    uciOut("info string weights " + value);
+                }
+                mcts.clear();
+            }
+            else if (name == "TablebasePath") {
+                // 空值 / <empty> = 不用殘局庫；檔案由 chess_ai tbgen <dir> 產生
+                if (!engine.loadTablebases(value))
+                    uciOut("info string [WARN] no tablebases found in " + value);
+                else if (engine.tablebases)
+                    uciOut("info string tablebases up to " + std::to_string(engine.tablebases->maxPieces) + " pieces from " + value);
+            }
+            else if (name == "MateHash") {
+                solver.hashMB = (size_t)std::max(1, std::atoi(value.c_str()));
+            }
+            else if (name == "SearchMode") {
+                // MCTS 也用 Threads；go mate 一律走 alpha-beta
+                searchMode = (value == "MCTS") ? SEARCH_MCTS : SEARCH_AB;
+                mcts.clear();
+            }
+            else if (name == "MctsHash") {
+                mcts.hashMB = (size_t)std::max(2, std::atoi(value.c_str()));
+            }
+            else {
+                uciOut("info string [WARN] unknown option " + name);
+            }
         }
         else if (line == "ucinewgame") {
+            stopSearch();
             pos.setStartPos();
+            engine.clearHash();
+            mcts.clear();
         }
         else if (line.rfind("position", 0) == 0) {
+            stopSearch();
             std::stringstream ss(line);
             std::string tok;
             ss >> tok; // position
@@ -243,7 +835,7 @@ static void runUCI() {
                     std::string fen = board + " " + active + " " + castlingStr + " " + epStr + " " + halfStr + " " + fullStr;
                     pos.setFEN(fen);
                 } else {
-                    std::cout << "info string [WARN] bad fen, falling back to startpos\n" << std::flush;
+                    uciOut("info string [WARN] bad fen, falling back to startpos");
                     pos.setStartPos();
                 }
             }
@@ -256,7 +848,7 @@ static void runUCI() {
                         Undo u;
                         pos.makeMove(m, u);
                     } else {
-                        std::cout << "info string [ERR] cannot parse move " << tok << "\n" << std::flush;
+                        uciOut("info string [ERR] cannot parse move " + tok);
                         break;
                     }
                 }
@@ -264,41 +856,112 @@ static void runUCI() {
 
         }
         else if (line.rfind("go", 0) == 0) {
-            int depth = 4;
+            stopSearch();
+
+            SearchLimits lim;
             std::stringstream ss(line);
             std::string tok;
             ss >> tok;
             while (ss >> tok) {
-                if (tok == "depth") ss >> depth;
+                if (tok == "depth") ss >> lim.depth;
+                else if (tok == "wtime") ss >> lim.time[0];
+                else if (tok == "btime") ss >> lim.time[1];
+                else if (tok == "winc") ss >> lim.inc[0];
+                else if (tok == "binc") ss >> lim.inc[1];
+                else if (tok == "movestogo") ss >> lim.movestogo;
+                else if (tok == "movetime") ss >> lim.movetime;
+                else if (tok == "nodes") ss >> lim.nodes;
+                else if (tok == "mate") ss >> lim.mate;
+                else if (tok == "infinite") lim.infinite = true;
+                else if (tok == "ponder") lim.ponder = true;
             }
+            // 什麼限制都沒給：維持舊行為，固定深度 4
+            if (lim.depth == 0 && !lim.useTimeManagement() && lim.movetime == 0 && lim.nodes == 0 && lim.mate == 0 && !lim.infinite && !lim.ponder)
+                lim.depth = 4;
+
+            control.stop = false;
+            control.ponder = lim.ponder;
+
+            searcher = std::thread([&engine, &control, &mcts, searchMode, pos, lim]() {
+                Position root = pos;
+                Move bm;
+                if (searchMode == SEARCH_MCTS && lim.mate == 0) {
+                    bm = mcts.bestMove(engine, root, lim);
+                    uciOut("info string mcts playouts " + std::to_string(mcts.lastPlayouts)
+                           + " reused " + std::to_string(mcts.lastReused) + " nodes");
+                }
+                else bm = engine.bestMove(root, lim);
 
-            Move bm = engine.bestMove(pos, depth, 0.0, nullptr);
+                // infinite / ponder：搜完也不能先送 bestmove，要等 stop 或 ponderhit
+                while ((lim.infinite || control.ponder) && !control.stop)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
 
-            // ===== 保證 bm 一定在合法棋清單內 =====
-            std::vector<Move> legal;
-            pos.genLegalMoves(legal);
+                // ===== 保證 bm 一定在合法棋清單內 =====
+                std::vector<Move> legal;
+                root.genLegalMoves(legal);
 
-            auto sameMove = [&](const Move& a, const Move& b){
-                return a.from == b.from && a.to == b.to && a.promo == b.promo;
-            };
+                bool ok = false;
+                for(const auto& m : legal){
+                    if(sameMove(m, bm)){ ok = true; break; }
+                }
 
-            bool ok = false;
-            for(const auto& m : legal){
-                if(sameMove(m, bm)){ ok = true; break; }
-            }
+                if(!ok){
+                    if(!legal.empty()) bm = legal[0];
+                }
 
-            if(!ok){
-                if(!legal.empty()) bm = legal[0];
+                std::string uci = moveToUci(bm);
+                if(uci.size() < 4 || legal.empty()) uci = "0000";   // 將死或逼和：沒有著法可回
+                if(ok && engine.lastPV.size() >= 2 && sameMove(engine.lastPV[0], bm))
+                    uci += " ponder " + moveToUci(engine.lastPV[1]);
+                uciOut("bestmove " + uci);
+            });
+        }
+        else if (line.rfind("solve", 0) == 0) {
+            // solve [mate N] [nodes X] [movetime ms]：df-pn 證明目前局面 N 步內有殺，stop 可中斷
+            stopSearch();
+            int mate = 5;
+            uint64_t nodeLimit = 0;
+            int64_t movetime = 0;
+            std::stringstream ss(line);
+            std::string tok;
+            ss >> tok;
+            while (ss >> tok) {
+                if (tok == "mate") ss >> mate;
+                else if (tok == "nodes") ss >> nodeLimit;
+                else if (tok == "movetime") ss >> movetime;
             }
-
-            std::string uci = moveToUci(bm);
-            if(uci.size() < 4) uci = "0000";
-            std::cout << "bestmove " << uci << "\n" << std::flush;
+            control.stop = false;
+            control.ponder = false;
+            solver.nodeLimit = nodeLimit;
+            solver.timeLimitMs = movetime;
+
+            searcher = std::thread([&solver, pos, mate]() {
+                DfpnResult r = solver.solve(pos, std::max(1, mate));
+                std::ostringstream os;
+                os << "info string dfpn " << dfpnStatusName(r.status);
+                if (r.status == DfpnResult::Proven) os << " in " << (r.matePlies + 1) / 2;
+                os << " nodes " << r.nodes
+                   << " time " << (int64_t)(r.seconds * 1000)
+                   << " hashfull " << r.hashfull;
+                uciOut(os.str());
+                if (r.status == DfpnResult::Proven) {
+                    std::ostringstream pv;
+                    pv << "info score mate " << (r.matePlies + 1) / 2
+                       << " nodes " << r.nodes
+                       << " time " << (int64_t)(r.seconds * 1000)
+                       << " pv";
+                    for (const Move& m : r.pv) pv << ' ' << moveToUci(m);
+                    uciOut(pv.str());
+                }
+                uciOut("bestmove " + (r.pv.empty() ? std::string("0000") : moveToUci(r.pv[0])));
+            });
         }
         else if (line == "quit") {
             break;
         }
     }
+
+    stopSearch();
 }
 
 // ============================
@@ -308,10 +971,48 @@ int main(int argc, char** argv) {
     if (argc >= 2 && std::string(argv[1]) == "bench") {
         int games = (argc >= 3) ? std::atoi(argv[2]) : 200;
         int depth = (argc >= 4) ? std::atoi(argv[3]) : 4;
-        runBench(games, depth);
+        uint64_t nodes = (argc >= 5) ? std::strtoull(argv[4], nullptr, 10) : 0;
+        runBench(games, depth, nodes);
+        return 0;
+    }
+    if (argc >= 2 && std::string(argv[1]) == "speed") {
+        int depth = (argc >= 3) ? std::atoi(argv[2]) : 7;
+        runSpeed(depth, (argc >= 4) ? argv[3] : "");
+        return 0;
+    }
+    if (argc >= 2 && std::string(argv[1]) == "evalcost") {
+        int depth = (argc >= 3) ? std::atoi(argv[2]) : 6;
+        runEvalCost(depth);
+        return 0;
+    }
+    if (argc >= 2 && std::string(argv[1]) == "parbench") {
+        int depth = (argc >= 3) ? std::atoi(argv[2]) : 5;
+        int threads = (argc >= 4) ? std::atoi(argv[3]) : (int)std::max(2u, std::thread::hardware_concurrency());
+        runParBench(depth, threads);
+        return 0;
+    }
+
+    if (argc >= 2 && std::string(argv[1]) == "mctsbench") {
+        uint64_t playouts = (argc >= 3) ? std::strtoull(argv[2], nullptr, 10) : 20000;
+        int depth = (argc >= 4) ? std::atoi(argv[3]) : 8;
+        int threads = (argc >= 5) ? std::atoi(argv[4]) : (int)std::max(1u, std::thread::hardware_concurrency());
+        runMctsBench(std::max<uint64_t>(1, playouts), depth, std::max(1, threads));
         return 0;
     }
 
+    if (argc >= 3 && std::string(argv[1]) == "tbgen") {
+        int threads = (argc >= 4) ? std::atoi(argv[3]) : (int)std::max(1u, std::thread::hardware_concurrency());
+        int pieces = (argc >= 5) ? std::atoi(argv[4]) : tb::MAX_PIECES;
+        return runTbGen(argv[2], std::max(1, threads), pieces);
+    }
+
+    if (argc >= 3 && std::string(argv[1]) == "solve") {
+        size_t hashMB = (argc >= 4) ? (size_t)std::max(1, std::atoi(argv[3])) : 64;
+        uint64_t nodes = (argc >= 5) ? std::strtoull(argv[4], nullptr, 10) : 0;
+        bool compare = !(argc >= 6 && std::string(argv[5]) == "nocompare");
+        return runSolve(argv[2], hashMB, nodes, compare);
+    }
+
     runUCI();
     return 0;
 }
@@ -0,0 +1,492 @@
+#pragma once
+#include "engine_real.hpp"
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+// =========================
+// MCTS / PUCT 搜尋模式
+// =========================
+// 每次 playout 從根用 PUCT 往下選到葉子、展開、用 qsearch 分數當葉值、沿路徑回傳。
+// 樹無鎖：節點欄位都是 atomic；展開用 state 的 CAS 搶，搶輸的執行緒直接評估同一個葉子。
+// virtual loss：下降時先把路徑記成輸，其他執行緒自然避開同一條線，回傳時再撤掉。
+// 節點從固定大小的池子連續配置（子節點一組連號），換步時把新根的子樹搬到另一個池子重用。
+enum SearchMode : int {
+    SEARCH_AB = 0,   // alpha-beta（預設）
+    SEARCH_MCTS
+};
+
+// 和 trainer 的勝率尺度一致：勝率 = sigmoid(cp / 160)，v = 2 * 勝率 - 1 = tanh(cp / 320)
+constexpr double MCTS_VALUE_CP = 160.0;
+
+struct MctsNode {
+    // LEAF：池滿時展開失敗，之後一律就地評估、不再嘗試展開
+    enum State : uint8_t { UNEXPANDED, EXPANDING, EXPANDED, TERMINAL, LEAF };
+    static constexpr int64_t VALUE_ONE = 1 << 16;   // valueSum 的定點刻度
+
+    std::atomic<uint32_t> visits{0};
+    std::atomic<int32_t> virtualLoss{0};
+    std::atomic<int64_t> valueSum{0};      // 走進這個節點的那一方的視角
+    std::atomic<uint8_t> state{UNEXPANDED};
+    int8_t terminalValue=0;                // TERMINAL：走子方視角（-1 被將死、0 和棋）
+    uint16_t move=0;                       // packMove；根節點為 0
+    uint16_t numChildren=0;                // EXPANDED 之後才有效
+    uint32_t firstChild=0;                 // 同上；子節點在池裡連號
+    float prior=0;
+
+    void init(uint16_t m, float p){
+        visits.store(0, std::memory_order_relaxed);
+        virtualLoss.store(0, std::memory_order_relaxed);
+        valueSum.store(0, std::memory_order_relaxed);
+        state.store(UNEXPANDED, std::memory_order_relaxed);
+        terminalValue = 0;
+        move = m;
+        numChildren = 0;
+        firstChild = 0;
+        prior = p;
+    }
+
+    // 走進這個節點的那一方的平均值
+    double q() const{
+        uint32_t n = visits.load(std::memory_order_relaxed);
+        return n ? (double)valueSum.load(std::memory_order_relaxed) / VALUE_ONE / n : 0.0;
+    }
+};
+
+// 節點池：索引 0 保留當「沒有」，根固定在 1；配置只有一個 atomic 游標
+struct MctsPool {
+    std::unique_ptr<MctsNode[]> nodes;
+    uint32_t capacity=0;
+    std::atomic<uint32_t> cursor{1};
+
+    void resize(size_t mb){
+        size_t n = std::max<size_t>(mb * 1024 * 1024 / sizeof(MctsNode), 1024);
+        n = std::min<size_t>(n, 0xFFFFFFF0u);
+        nodes.reset(new MctsNode[n]);
+        capacity = (uint32_t)n;
+        cursor = 1;
+    }
+
+    void clear(){ cursor = 1; }
+
+    // 配置 n 個連號節點；放不下時回傳 0。先檢查再 CAS，游標不會超出容量（也就不會繞回去蓋掉用中的節點）
+    uint32_t alloc(uint32_t n){
+        uint32_t i = cursor.load(std::memory_order_relaxed);
+        do{
+            if((uint64_t)i + n > capacity) return 0;
+        }while(!cursor.compare_exchange_weak(i, i + n, std::memory_order_relaxed));
+        return i;
+    }
+
+    uint32_t used() const{ return cursor.load(std::memory_order_relaxed); }
+    int permille() const{ return capacity ? (int)((uint64_t)used() * 1000 / capacity) : 0; }
+
+    MctsNode& operator[](uint32_t i){ return nodes[i]; }
+    const MctsNode& operator[](uint32_t i) const{ return nodes[i]; }
+};
+
+struct MctsSearch {
+    static constexpr uint32_t ROOT = 1;
+    static constexpr int MAX_TREE_DEPTH = MAX_PLY / 2;   // 留一半 ply 給葉子的 qsearch
+    static constexpr uint64_t REPORT_MS = 1000;
+
+    size_t hashMB=128;            // 兩個池子合計（UCI MctsHash）
+    double cpuct=1.5;
+    double fpuReduction=0.0;      // 沒走過的子節點 Q = 父節點 Q - fpuReduction（先驗很平，不宜大）
+    bool reuseTree=true;
+
+    uint64_t lastPlayouts=0;      // 上一次搜尋的 playout 數
+    uint32_t lastReused=0;        // 上一次搜尋開始時從舊樹沿用的節點數
+    double lastSeconds=0;
+
+    // 清掉樹（ucinewgame、換權重 / 評估）
+    void clear(){
+        hasTree = false;
+        if(pool[cur].nodes) pool[cur].clear();
+    }
+
+    // 用 e 的評估與執行緒設定（e.threads）搜 root；結果也寫進 e.lastPV / e.lastNodes，
+    // 每秒與結束時經 e.onIter 回報（nodes = playout 數）
+    Move bestMove(Engine& e, const Position& root, const SearchLimits& lim){
+        Position p = root;
+        e.lastNodes = 0;
+        e.lastPV.clear();
+        lastPlayouts = 0;
+
+        MoveList moves;
+        p.genLegalMoves(moves);
+        if(moves.empty()) return Move{};
+
+        ensurePools();
+        prepareRoot(p);
+        treePos = p;
+        hasTree = true;
+
+        SearchShared shared;
+        shared.tm.init(lim, p.whiteToMove, e.moveOverhead);
+        shared.control = e.control;
+        const int nThreads = std::max(1, e.threads);
+        e.ensureTT();
+        e.ensureWorkers(nThreads);
+
+        std::atomic<uint64_t> playouts{0};
+        std::atomic<uint64_t> depthSum{0};
+        uint64_t nextReport = REPORT_MS;
+        auto report = [&](){
+            if(!e.onIter) return;
+            SearchInfo info = rootInfo(playouts, depthSum);
+            info.timeMs = shared.tm.elapsed();
+            e.onIter(info);
+        };
+
+        // 停止條件只由 0 號執行緒判斷（其餘看 shared.stop）
+        auto shouldStop = [&](){
+            uint64_t n = playouts.load(std::memory_order_relaxed);
+            if(e.control && e.control->stop) return true;
+            if(lim.nodes && n >= lim.nodes) return true;
+            if(lim.depth && n && depthSum.load(std::memory_order_relaxed) >= (uint64_t)lim.depth * n) return true;
+            if(shared.pondering()) return false;
+            if(shared.tm.active){
+                int64_t ms = shared.tm.elapsed();
+                if(ms >= (shared.tm.fixedTime ? shared.tm.maximumMs : shared.tm.optimumMs)) return true;
+            }
+            return false;
+        };
+
+        auto worker = [&](int id){
+            SearchThread& t = *(*e.workers)[id];
+            t.id = id;
+            t.nodes = 0;
+            t.sp = nullptr;
+            t.pool = nullptr;
+            t.shared = &shared;
+            t.resetStack();
+            t.nnue.top = 0;
+            std::fill(std::begin(t.lazyExits), std::end(t.lazyExits), 0);
+            t.tbHits = 0;
+            Position pos = p;
+            e.attachPsq(pos);
+            e.attachNnue(t, pos);
+            e.withEvaluator([&](auto ev){
+                while(!shared.stop){
+                    int depth = playout<decltype(ev)>(e, t, pos);
+                    if(depth < 0) break;
+                    depthSum.fetch_add((uint64_t)depth, std::memory_order_relaxed);
+                    uint64_t n = playouts.fetch_add(1, std::memory_order_relaxed) + 1;
+                    if(id == 0 && (n & 15) == 0){
+                        if(shouldStop()) shared.stop = true;
+                        else if((uint64_t)shared.tm.elapsed() >= nextReport){
+                            report();
+                            nextReport += REPORT_MS;
+                        }
+                    }
+                }
+                return 0;
+            });
+        };
+
+        std::vector<std::thread> helpers;
+        for(int i=1;i<nThreads;i++) helpers.emplace_back(worker, i);
+        worker(0);
+        for(auto& th : helpers) th.join();
+
+        // infinite / ponder 在 UCI 端等 stop，這裡只負責搜
+        Move best = moves[0];
+        std::vector<Move> pv = principalVariation(p);
+        if(!pv.empty()) best = pv[0];
+        report();
+
+        lastPlayouts = playouts;
+        lastSeconds = shared.tm.elapsed() / 1000.0;
+        e.lastPV = pv.empty() ? std::vector<Move>{best} : pv;
+        e.lastNodes = 0;
+        e.lastTbHits = 0;
+        for(int i=0;i<nThreads;i++) e.lastNodes += (*e.workers)[i]->nodes;
+        return best;
+    }
+
+private:
+    MctsPool pool[2];
+    int cur=0;
+    bool hasTree=false;
+    Position treePos;             // 目前樹根的局面（換步時找新根用）
+    size_t poolMB=0;
+
+    void ensurePools(){
+        size_t mb = std::max<size_t>(hashMB / 2, 1);
+        if(!pool[0].nodes || poolMB != mb){
+            pool[0].resize(mb);
+            pool[1].resize(mb);
+            poolMB = mb;
+            hasTree = false;
+        }
+    }
+
+    static bool samePosition(const Position& a, const Position& b){
+        return a.key == b.key && a.b == b.b && a.whiteToMove == b.whiteToMove;
+    }
+
+    // 在舊樹裡找 root（同局面、走了一步或兩步之後），找到就把那棵子樹搬到另一個池子
+    void prepareRoot(const Position& root){
+        MctsPool& P = pool[cur];
+        uint32_t found = 0;
+        if(reuseTree && hasTree){
+            if(samePosition(treePos, root)) found = ROOT;
+            Position pos = treePos;
+            pos.nnue = nullptr;
+            for(uint32_t i=0; !found && i<childCount(P, ROOT); i++){
+                uint32_t c = P[ROOT].firstChild + i;
+                Move m1;
+                Undo u1;
+                if(!findMove(pos, P[c].move, m1)) continue;
+                pos.makeMove(m1, u1);
+                if(samePosition(pos, root)) found = c;
+                for(uint32_t j=0; !found && j<childCount(P, c); j++){
+                    uint32_t g = P[c].firstChild + j;
+                    Move m2;
+                    Undo u2;
+                    if(!findMove(pos, P[g].move, m2)) continue;
+                    pos.makeMove(m2, u2);
+                    if(samePosition(pos, root)) found = g;
+                    pos.unmakeMove(m2, u2);
+                }
+                pos.unmakeMove(m1, u1);
+            }
+        }
+        lastReused = 0;
+        if(found && P[found].state.load() != MctsNode::TERMINAL){
+            cur ^= 1;
+            lastReused = copySubtree(P, found, pool[cur]);
+        }else{
+            pool[cur].clear();
+            uint32_t r = pool[cur].alloc(1);
+            pool[cur][r].init(0, 1.0f);
+        }
+    }
+
+    static uint32_t childCount(const MctsPool& P, uint32_t n){
+        return P[n].state.load(std::memory_order_acquire) == MctsNode::EXPANDED ? P[n].numChildren : 0;
+    }
+
+    static bool findMove(Position& pos, uint16_t packed, Move& out){
+        MoveList moves;
+        pos.genLegalMoves(moves);
+        for(const Move& m : moves) if(matchesPacked(m, packed)){ out = m; return true; }
+        return false;
+    }
+
+    // 廣度優先複製（子節點保持連號），回傳複製的節點數；EXPANDING 不會留到搜尋之外
+    static uint32_t copySubtree(const MctsPool& src, uint32_t from, MctsPool& dst){
+        dst.clear();
+        std::vector<std::pair<uint32_t, uint32_t>> queue;
+        uint32_t r = dst.alloc(1);
+        copyNode(src[from], dst[r]);
+        dst[r].move = 0;
+        queue.emplace_back(from, r);
+        for(size_t qi=0; qi<queue.size(); qi++){
+            uint32_t s = queue[qi].first, d = queue[qi].second;
+            uint32_t n = childCount(src, s);
+            if(!n) continue;
+            uint32_t first = dst.alloc(n);
+            if(!first){
+                dst[d].state.store(MctsNode::LEAF, std::memory_order_relaxed);
+                continue;
+            }
+            for(uint32_t i=0;i<n;i++){
+                copyNode(src[src[s].firstChild + i], dst[first + i]);
+                queue.emplace_back(src[s].firstChild + i, first + i);
+            }
+            dst[d].firstChild = first;
+            dst[d].numChildren = (uint16_t)n;
+        }
+        return (uint32_t)queue.size();
+    }
+
+    static void copyNode(const MctsNode& s, MctsNode& d){
+        d.init(s.move, s.prior);
+        d.visits.store(s.visits.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        d.valueSum.store(s.valueSum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        uint8_t st = s.state.load(std::memory_order_relaxed);
+        // 子節點由 copySubtree 接上；其餘狀態一律當沒展開
+        d.state.store(st == MctsNode::TERMINAL ? MctsNode::TERMINAL
+                    : st == MctsNode::EXPANDED ? MctsNode::EXPANDED : MctsNode::UNEXPANDED, std::memory_order_relaxed);
+        d.terminalValue = s.terminalValue;
+    }
+
+    // 先驗：吃子看 SEE、升變加分、安靜著看 PST（MG）增減，softmax 成機率
+    static void priors(const Engine& e, const Position& pos, const MoveList& moves, float* out){
+        float maxLogit = -1e9f;
+        for(size_t i=0;i<moves.size();i++){
+            const Move& m = moves[i];
+            Piece pc = pos.b[m.from];
+            int id = (pc-1) % 6;
+            bool white = isWhite(pc);
+            int from = white ? m.from : 63 - m.from, to = white ? m.to : 63 - m.to;
+            float logit = (e.w.pst[MG][id][to] - e.w.pst[MG][id][from]) / 100.0f;
+            if(isTactical(pos, m)) logit += 0.5f + std::max(-2.0f, std::min(2.0f, see(pos, m) / 200.0f));
+            if(m.promo != EMPTY) logit += (m.promo == WQ || m.promo == BQ) ? 2.0f : -1.0f;
+            out[i] = logit;
+            maxLogit = std::max(maxLogit, logit);
+        }
+        float sum = 0;
+        for(size_t i=0;i<moves.size();i++){
+            out[i] = std::exp(out[i] - maxLogit);
+            sum += out[i];
+        }
+        for(size_t i=0;i<moves.size();i++) out[i] /= sum;
+    }
+
+    // 走子方視角的葉值：qsearch 分數轉成 [-1, 1]
+    template<class Ev>
+    static double leafValue(const Engine& e, SearchThread& t, Position& pos, int depth){
+        StackEntry* ss = t.stack(depth);
+        int cp = pos.isInCheck(pos.whiteToMove) ? e.qsearch<Ev, true>(t, pos, ss, -Engine::INF, Engine::INF)
+                                                : e.qsearch<Ev, false>(t, pos, ss, -Engine::INF, Engine::INF);
+        if(cp >= MATE_BOUND) return 1.0;
+        if(cp <= -MATE_BOUND) return -1.0;
+        return std::tanh(cp / (2.0 * MCTS_VALUE_CP));
+    }
+
+    // 展開 node（已搶到 EXPANDING）：沒著法就變 TERMINAL；池滿就變 LEAF（永久葉子，不再重試）
+    void expand(const Engine& e, Position& pos, MctsNode& node){
+        MctsPool& P = pool[cur];
+        MoveList moves;
+        pos.genLegalMoves(moves);
+        if(moves.empty()){
+            node.terminalValue = pos.isInCheck(pos.whiteToMove) ? -1 : 0;
+            node.state.store(MctsNode::TERMINAL, std::memory_order_release);
+            return;
+        }
+        uint32_t first = P.alloc((uint32_t)moves.size());
+        if(!first){
+            node.state.store(MctsNode::LEAF, std::memory_order_release);
+            return;
+        }
+        float pr[MAX_MOVES];
+        priors(e, pos, moves, pr);
+        for(size_t i=0;i<moves.size();i++) P[first + (uint32_t)i].init(packMove(moves[i]), pr[i]);
+        node.firstChild = first;
+        node.numChildren = (uint16_t)moves.size();
+        node.state.store(MctsNode::EXPANDED, std::memory_order_release);
+    }
+
+    uint32_t select(const MctsNode& node) const{
+        const MctsPool& P = pool[cur];
+        uint32_t parentN = node.visits.load(std::memory_order_relaxed) + node.virtualLoss.load(std::memory_order_relaxed);
+        double sqrtN = std::sqrt((double)std::max<uint32_t>(parentN, 1));
+        double fpu = -node.q() - fpuReduction;   // node.q() 是對手視角
+        uint32_t best = node.firstChild;
+        double bestScore = -1e18;
+        for(uint32_t i=0;i<node.numChildren;i++){
+            const MctsNode& c = P[node.firstChild + i];
+            uint32_t n = c.visits.load(std::memory_order_relaxed);
+            int32_t vl = c.virtualLoss.load(std::memory_order_relaxed);
+            uint32_t N = n + (uint32_t)vl;
+            double q = N ? ((double)c.valueSum.load(std::memory_order_relaxed) / MctsNode::VALUE_ONE - vl) / N : fpu;
+            double score = q + cpuct * c.prior * sqrtN / (1 + N);
+            if(score > bestScore){
+                bestScore = score;
+                best = node.firstChild + i;
+            }
+        }
+        return best;
+    }
+
+    // 一次 playout，回傳葉子深度；被叫停時回 -1（路徑上的 virtual loss 照樣撤掉）
+    template<class Ev>
+    int playout(const Engine& e, SearchThread& t, Position& pos){
+        MctsPool& P = pool[cur];
+        uint32_t path[MAX_TREE_DEPTH+1];
+        Move moves[MAX_TREE_DEPTH];
+        Undo undo[MAX_TREE_DEPTH];
+        int depth = 0;
+        uint32_t n = ROOT;
+        double v;
+        while(true){
+            MctsNode& node = P[n];
+            path[depth] = n;
+            node.virtualLoss.fetch_add(1, std::memory_order_relaxed);
+            uint8_t st = node.state.load(std::memory_order_acquire);
+            if(st == MctsNode::TERMINAL){ v = node.terminalValue; break; }
+            if(depth > 0 && pos.halfmoveClock >= 100){ v = 0; break; }
+            if(st == MctsNode::UNEXPANDED && depth < MAX_TREE_DEPTH
+               && node.state.compare_exchange_strong(st, MctsNode::EXPANDING, std::memory_order_acq_rel)){
+                expand(e, pos, node);
+                st = node.state.load(std::memory_order_relaxed);
+                v = st == MctsNode::TERMINAL ? node.terminalValue : leafValue<Ev>(e, t, pos, depth);
+                break;
+            }
+            // 別的執行緒正在展開、永久葉子或到深度上限：就地評估
+            if(st != MctsNode::EXPANDED){ v = leafValue<Ev>(e, t, pos, depth); break; }
+
+            n = select(node);
+            if(!findMove(pos, P[n].move, moves[depth])){ v = 0; break; }   // 不該發生：著法與局面對不上
+            pos.makeMove(moves[depth], undo[depth]);
+            depth++;
+        }
+
+        const bool stopped = t.aborted();
+        // v 是葉子走子方的視角；節點存的是走進它的那一方，所以葉子本身記 -v，往上交替
+        double x = -v;
+        for(int d=depth; d>=0; d--){
+            MctsNode& node = P[path[d]];
+            if(!stopped){
+                node.valueSum.fetch_add((int64_t)std::llround(x * MctsNode::VALUE_ONE), std::memory_order_relaxed);
+                node.visits.fetch_add(1, std::memory_order_relaxed);
+            }
+            node.virtualLoss.fetch_sub(1, std::memory_order_relaxed);
+            x = -x;
+            if(d > 0) pos.unmakeMove(moves[d-1], undo[d-1]);
+        }
+        return stopped ? -1 : depth;
+    }
+
+    // 沿最多訪問的子節點走（訪問數太少的不算）
+    std::vector<Move> principalVariation(const Position& root) const{
+        const MctsPool& P = pool[cur];
+        std::vector<Move> pv;
+        Position pos = root;
+        pos.nnue = nullptr;
+        pos.setPsqTable(nullptr);
+        uint32_t n = ROOT;
+        while(pv.size() < (size_t)MAX_TREE_DEPTH){
+            uint32_t cnt = childCount(P, n);
+            if(!cnt) break;
+            uint32_t best = 0, bestVisits = 0;
+            for(uint32_t i=0;i<cnt;i++){
+                uint32_t c = P[n].firstChild + i;
+                uint32_t v = P[c].visits.load(std::memory_order_relaxed);
+                if(v > bestVisits){ bestVisits = v; best = c; }
+            }
+            if(!best || (pv.size() && bestVisits < 2)) break;
+            Move m;
+            if(!findMove(pos, P[best].move, m)) break;
+            Undo u;
+            pos.makeMove(m, u);
+            pv.push_back(m);
+            n = best;
+        }
+        return pv;
+    }
+
+    SearchInfo rootInfo(uint64_t playouts, uint64_t depthSum) const{
+        const MctsPool& P = pool[cur];
+        SearchInfo info;
+        info.nodes = playouts;
+        info.depth = playouts ? (int)((depthSum + playouts/2) / playouts) : 0;
+        info.hashfull = P.permille();
+        info.pv = principalVariation(treePos);
+        if(!info.pv.empty()) info.best = info.pv[0];
+        // 根節點 Q 是對手視角；走子方的分數取最多訪問子節點的 Q
+        double q = 0;
+        uint32_t bestVisits = 0;
+        for(uint32_t i=0;i<childCount(P, ROOT);i++){
+            const MctsNode& c = P[P[ROOT].firstChild + i];
+            uint32_t v = c.visits.load(std::memory_order_relaxed);
+            if(v > bestVisits){ bestVisits = v; q = c.q(); }
+        }
+        q = std::max(-0.999, std::min(0.999, q));
+        info.score = (int)std::lround(2.0 * MCTS_VALUE_CP * std::atanh(q));
+        return info;
+    }
+};
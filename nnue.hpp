@@ -0,0 +1,236 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+
+// =========================
+// NNUE：768 -> HIDDEN x2 -> 1
+// =========================
+// 輸入是 (顏色, 種類, 格) 的 one-hot，兩個視角各一份：黑方視角把盤面上下翻轉、顏色對調，
+// 所以同一組 feature transformer 權重兩邊共用。隱藏層 int16 累加器依走子增量更新，
+// 輸出層把 [走子方, 對手] 兩個累加器串起來，過 clipped ReLU 後做一次內積。
+// 量化（對照 stockfish/src/nnue 的簡化版）：
+//   累加器 = Σ 權重，單位 1/NNUE_QA；輸出權重單位 1/NNUE_QB；輸出偏置單位 1/(QA*QB)
+//   分數（走子方視角，centipawn）= (Σ clamp(acc,0,QA) * w + bias) * NNUE_SCALE / (QA*QB)
+constexpr int NNUE_INPUTS = 768;
+constexpr int NNUE_HIDDEN = 256;
+constexpr int NNUE_QA     = 255;
+constexpr int NNUE_QB     = 64;
+constexpr int NNUE_SCALE  = 400;
+
+// 檔頭：magic、版本、輸入數、隱藏層寬度；之後依序是 little-endian 的
+// int16 ftWeights[768][HIDDEN]、int16 ftBias[HIDDEN]、int16 outWeights[2*HIDDEN]、int32 outBias
+constexpr uint32_t NNUE_MAGIC   = 0x554E4E43;   // "CNNU"
+constexpr uint32_t NNUE_VERSION = 1;
+
+// pc 為 Piece（1..6 白 P..K、7..12 黑 P..K）；persp 0 = 白方視角、1 = 黑方視角
+inline int nnueFeature(int persp, int pc, int sq){
+    int color = pc >= 7, type = (pc-1) % 6;
+    if(persp) { color ^= 1; sq ^= 56; }
+    return (color*6 + type) * 64 + sq;
+}
+
+struct NnueNetwork {
+    alignas(64) int16_t ftWeights[NNUE_INPUTS][NNUE_HIDDEN]{};
+    alignas(64) int16_t ftBias[NNUE_HIDDEN]{};
+    alignas(64) int16_t outWeights[2*NNUE_HIDDEN]{};
+    int32_t outBias=0;
+
+    bool load(const std::string& path){
+        std::ifstream in(path, std::ios::binary);
+        if(!in) return false;
+        uint32_t header[4];
+        in.read(reinterpret_cast<char*>(header), sizeof header);
+        if(!in || header[0]!=NNUE_MAGIC || header[1]!=NNUE_VERSION
+           || header[2]!=NNUE_INPUTS || header[3]!=NNUE_HIDDEN) return false;
+        in.read(reinterpret_cast<char*>(ftWeights), sizeof ftWeights);
+        in.read(reinterpret_cast<char*>(ftBias), sizeof ftBias);
+        in.read(reinterpret_cast<char*>(outWeights), sizeof outWeights);
+        in.read(reinterpret_cast<char*>(&outBias), sizeof outBias);
+        return (bool)in;
+    }
+
+    bool save(const std::string& path) const{
+        std::ofstream out(path, std::ios::binary);
+        if(!out) return false;
+        const uint32_t header[4] = {NNUE_MAGIC, NNUE_VERSION, NNUE_INPUTS, NNUE_HIDDEN};
+        out.write(reinterpret_cast<const char*>(header), sizeof header);
+        out.write(reinterpret_cast<const char*>(ftWeights), sizeof ftWeights);
+        out.write(reinterpret_cast<const char*>(ftBias), sizeof ftBias);
+        out.write(reinterpret_cast<const char*>(outWeights), sizeof outWeights);
+        out.write(reinterpret_cast<const char*>(&outBias), sizeof outBias);
+        return (bool)out;
+    }
+
+    static std::shared_ptr<const NnueNetwork> fromFile(const std::string& path){
+        auto net = std::make_shared<NnueNetwork>();
+        if(!net->load(path)) return nullptr;
+        return net;
+    }
+};
+
+// =========================
+// 向量化核心（AVX2 / SSE4.1，否則純量）；編譯時依 -mavx2 / -msse4.1 選擇
+// =========================
+namespace nnue_simd {
+
+inline void addRow(int16_t* acc, const int16_t* w){
+#if defined(__AVX2__)
+    for(int i=0;i<NNUE_HIDDEN;i+=16){
+        __m256i a = _mm256_load_si256(reinterpret_cast<const __m256i*>(acc+i));
+        __m256i b = _mm256_load_si256(reinterpret_cast<const __m256i*>(w+i));
+        _mm256_store_si256(reinterpret_cast<__m256i*>(acc+i), _mm256_add_epi16(a, b));
+    }
+#elif defined(__SSE4_1__)
+    for(int i=0;i<NNUE_HIDDEN;i+=8){
+        __m128i a = _mm_load_si128(reinterpret_cast<const __m128i*>(acc+i));
+        __m128i b = _mm_load_si128(reinterpret_cast<const __m128i*>(w+i));
+        _mm_store_si128(reinterpret_cast<__m128i*>(acc+i), _mm_add_epi16(a, b));
+    }
+#else
+    for(int i=0;i<NNUE_HIDDEN;i++) acc[i] = (int16_t)(acc[i] + w[i]);
+#endif
+}
+
+inline void subRow(int16_t* acc, const int16_t* w){
+#if defined(__AVX2__)
+    for(int i=0;i<NNUE_HIDDEN;i+=16){
+        __m256i a = _mm256_load_si256(reinterpret_cast<const __m256i*>(acc+i));
+        __m256i b = _mm256_load_si256(reinterpret_cast<const __m256i*>(w+i));
+        _mm256_store_si256(reinterpret_cast<__m256i*>(acc+i), _mm256_sub_epi16(a, b));
+    }
+#elif defined(__SSE4_1__)
+    for(int i=0;i<NNUE_HIDDEN;i+=8){
+        __m128i a = _mm_load_si128(reinterpret_cast<const __m128i*>(acc+i));
+        __m128i b = _mm_load_si128(reinterpret_cast<const __m128i*>(w+i));
+        _mm_store_si128(reinterpret_cast<__m128i*>(acc+i), _mm_sub_epi16(a, b));
+    }
+#else
+    for(int i=0;i<NNUE_HIDDEN;i++) acc[i] = (int16_t)(acc[i] - w[i]);
+#endif
+}
+
+// Σ clamp(acc[i], 0, QA) * w[i]；乘積最多 255*32767，每個 int32 lane 累加 HIDDEN/8 對不會溢位
+inline int32_t creluDot(const int16_t* acc, const int16_t* w){
+#if defined(__AVX2__)
+    const __m256i zero = _mm256_setzero_si256(), qa = _mm256_set1_epi16(NNUE_QA);
+    __m256i sum = _mm256_setzero_si256();
+    for(int i=0;i<NNUE_HIDDEN;i+=16){
+        __m256i a = _mm256_load_si256(reinterpret_cast<const __m256i*>(acc+i));
+        a = _mm256_min_epi16(_mm256_max_epi16(a, zero), qa);
+        __m256i b = _mm256_load_si256(reinterpret_cast<const __m256i*>(w+i));
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(a, b));
+    }
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+    return _mm_cvtsi128_si32(s);
+#elif defined(__SSE4_1__)
+    const __m128i zero = _mm_setzero_si128(), qa = _mm_set1_epi16(NNUE_QA);
+    __m128i sum = _mm_setzero_si128();
+    for(int i=0;i<NNUE_HIDDEN;i+=8){
+        __m128i a = _mm_load_si128(reinterpret_cast<const __m128i*>(acc+i));
+        a = _mm_min_epi16(_mm_max_epi16(a, zero), qa);
+        __m128i b = _mm_load_si128(reinterpret_cast<const __m128i*>(w+i));
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(a, b));
+    }
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+    return _mm_cvtsi128_si32(sum);
+#else
+    int32_t sum = 0;
+    for(int i=0;i<NNUE_HIDDEN;i++){
+        int v = acc[i] < 0 ? 0 : acc[i] > NNUE_QA ? NNUE_QA : acc[i];
+        sum += v * w[i];
+    }
+    return sum;
+#endif
+}
+
+} // namespace nnue_simd
+
+// =========================
+// 累加器堆疊
+// =========================
+// makeMove 只記下這一步動了哪些棋子（最多減 2、加 2：吃子、升變、王車易位），unmakeMove 直接 pop。
+// 真正的向量加減延到 evaluate 才做，從最近一個算好的祖先往上補；沒被評估的節點不花任何累加成本。
+struct NnueAccumulator {
+    alignas(64) int16_t v[2][NNUE_HIDDEN];   // [白方視角 / 黑方視角]
+    bool computed=false;
+    uint8_t nAdd=0, nSub=0;
+    uint8_t addPc[2], addSq[2], subPc[2], subSq[2];
+
+    void add(int pc, int sq){ addPc[nAdd] = (uint8_t)pc; addSq[nAdd++] = (uint8_t)sq; }
+    void sub(int pc, int sq){ subPc[nSub] = (uint8_t)pc; subSq[nSub++] = (uint8_t)sq; }
+};
+
+struct NnueStack {
+    const NnueNetwork* net=nullptr;
+    std::vector<NnueAccumulator> acc = std::vector<NnueAccumulator>(256);
+    int top=0;
+
+    // makeMove 開頭呼叫：開一層空的差分
+    NnueAccumulator& push(){
+        if(++top == (int)acc.size()) acc.emplace_back();
+        NnueAccumulator& a = acc[top];
+        a.computed = false;
+        a.nAdd = a.nSub = 0;
+        return a;
+    }
+    void pop(){ top--; }
+
+    // 在目前 top 之上放一個從盤面整個重算的根（不動下面的層，分裂點的 helper 用完可以退回原本的 top）
+    template<class Board>
+    void pushRoot(const NnueNetwork* n, const Board& b){
+        net = n;
+        refresh(*n, push(), b);
+    }
+
+    template<class Board>
+    static void refresh(const NnueNetwork& net, NnueAccumulator& a, const Board& b){
+        for(int p=0;p<2;p++){
+            std::memcpy(a.v[p], net.ftBias, sizeof a.v[p]);
+            for(int sq=0;sq<64;sq++)
+                if(int(b[sq])) nnue_simd::addRow(a.v[p], net.ftWeights[nnueFeature(p, int(b[sq]), sq)]);
+        }
+        a.computed = true;
+    }
+
+    // 走子方視角的分數
+    int evaluate(bool whiteToMove){
+        int i = top;
+        while(!acc[i].computed) i--;
+        for(i++; i<=top; i++){
+            NnueAccumulator& a = acc[i];
+            std::memcpy(a.v, acc[i-1].v, sizeof a.v);
+            for(int p=0;p<2;p++){
+                for(int k=0;k<a.nSub;k++) nnue_simd::subRow(a.v[p], net->ftWeights[nnueFeature(p, a.subPc[k], a.subSq[k])]);
+                for(int k=0;k<a.nAdd;k++) nnue_simd::addRow(a.v[p], net->ftWeights[nnueFeature(p, a.addPc[k], a.addSq[k])]);
+            }
+            a.computed = true;
+        }
+        return output(*net, acc[top], whiteToMove);
+    }
+
+    static int output(const NnueNetwork& net, const NnueAccumulator& a, bool whiteToMove){
+        int us = whiteToMove ? 0 : 1;
+        int64_t sum = (int64_t)nnue_simd::creluDot(a.v[us], net.outWeights)
+                    + nnue_simd::creluDot(a.v[us^1], net.outWeights + NNUE_HIDDEN)
+                    + net.outBias;
+        return (int)(sum * NNUE_SCALE / (NNUE_QA * NNUE_QB));
+    }
+};
+
+// 沒掛累加器堆疊的局面（搜尋以外）：整個重算
+template<class Board>
+inline int nnueEvaluateFull(const NnueNetwork& net, const Board& b, bool whiteToMove){
+    NnueAccumulator a;
+    NnueStack::refresh(net, a, b);
+    return NnueStack::output(net, a, whiteToMove);
+}
@@ -0,0 +1,835 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bitboard.hpp"
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+// minwindef.h 把 IN / OUT / OPTIONAL 定義成空巨集，會吃掉同名的常數
+#undef IN
+#undef OUT
+#undef OPTIONAL
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// =========================
+// 殘局庫（3 / 4 子，自有格式）
+// =========================
+// 逆推（retrograde）產生，每張表存兩份資料：
+//   WDL：每局面 2 bits（0 和、1 走子方勝、2 走子方負、3 不合法），搜尋中查這份
+//   DTM：每局面 1 byte，0 = 和 / 未定、255 = 不合法、其餘 v → 距離將死 v-1 ply（奇數 = 走子方勝）
+// 索引不含易位權與過路兵；50 步規則不計。表一律以「強方 = 白」存，查詢時必要時翻轉顏色。
+// 對稱：無兵表把白王放進 a1-d1-d4 三角（10 格），有兵表把領頭兵放到 a-d 線（24 格）。
+namespace tb {
+
+enum PieceType : int { NO_TYPE = 0, PAWN, KNIGHT, BISHOP, ROOK, QUEEN, KING };
+
+constexpr int MAX_PIECES = 4;
+constexpr uint8_t DRAW = 0;
+constexpr uint8_t INVALID = 255;
+constexpr int MAX_DTM = 253;
+constexpr int KEY_SPACE = 59049;    // 3^10：每種（顏色, 非王棋子）最多 2 顆
+
+inline uint8_t encodeDtm(int dtm){ return (uint8_t)(dtm + 1); }
+inline int dtmOf(uint8_t v){ return v - 1; }
+inline bool isWin(uint8_t v){ return v != DRAW && v != INVALID && (dtmOf(v) & 1); }
+inline bool isLoss(uint8_t v){ return v != DRAW && v != INVALID && !(dtmOf(v) & 1); }
+
+struct PieceSq {
+    int8_t type=NO_TYPE, color=0, sq=0;   // color 0 = 白
+};
+
+struct Board {
+    PieceSq p[MAX_PIECES];
+    int n=0;
+    int stm=0;
+
+    uint64_t occupied() const{
+        uint64_t o = 0;
+        for(int i=0;i<n;i++) o |= 1ULL << p[i].sq;
+        return o;
+    }
+    int king(int color) const{
+        for(int i=0;i<n;i++) if(p[i].type==KING && p[i].color==color) return p[i].sq;
+        return -1;
+    }
+    int at(int sq) const{
+        for(int i=0;i<n;i++) if(p[i].sq==sq) return i;
+        return -1;
+    }
+    void remove(int i){
+        p[i] = p[--n];
+    }
+};
+
+inline int materialKey(const Board& b){
+    static const int POW3[10] = {1, 3, 9, 27, 81, 243, 729, 2187, 6561, 19683};
+    int k = 0;
+    for(int i=0;i<b.n;i++)
+        if(b.p[i].type != KING) k += POW3[b.p[i].color*5 + b.p[i].type - 1];
+    return k;
+}
+
+inline uint64_t attacksFrom(int type, int color, int sq, uint64_t occ){
+    switch(type){
+        case PAWN:   return pawnAttacksBB(color==0, 1ULL << sq);
+        case KNIGHT: return ATTACKS.knight[sq];
+        case BISHOP: return bishopAttacks(sq, occ);
+        case ROOK:   return rookAttacks(sq, occ);
+        case QUEEN:  return bishopAttacks(sq, occ) | rookAttacks(sq, occ);
+        case KING:   return ATTACKS.king[sq];
+        default:     return 0;
+    }
+}
+
+inline bool attacked(const Board& b, int sq, int byColor){
+    uint64_t occ = b.occupied();
+    for(int i=0;i<b.n;i++)
+        if(b.p[i].color==byColor && (attacksFrom(b.p[i].type, byColor, b.p[i].sq, occ) >> sq & 1)) return true;
+    return false;
+}
+
+inline bool inCheck(const Board& b, int color){
+    int k = b.king(color);
+    return k >= 0 && attacked(b, k, color ^ 1);
+}
+
+// 走子方的合法著，逐一交給 fn(child, conversion, doublePush)；conversion = 吃子或升變（子力組成改變）
+template<class Fn>
+inline void forEachMove(const Board& b, Fn&& fn){
+    const uint64_t occ = b.occupied();
+    auto emit = [&](int i, int to, int promo, bool doublePush){
+        Board c = b;
+        bool conv = promo != NO_TYPE;
+        int cap = c.at(to);
+        c.p[i].sq = (int8_t)to;
+        if(promo) c.p[i].type = (int8_t)promo;
+        if(cap >= 0){
+            c.remove(cap);
+            conv = true;
+        }
+        c.stm ^= 1;
+        if(!inCheck(c, b.stm)) fn(c, conv, doublePush);
+    };
+    for(int i=0;i<b.n;i++){
+        const PieceSq& pc = b.p[i];
+        if(pc.color != b.stm) continue;
+        uint64_t own = 0, enemy = 0;
+        for(int j=0;j<b.n;j++) (b.p[j].color==b.stm ? own : enemy) |= 1ULL << b.p[j].sq;
+        // 王不能被吃：敵王所在格不算目標
+        enemy &= ~(1ULL << b.king(b.stm ^ 1));
+        if(pc.type == PAWN){
+            int dir = pc.color==0 ? 8 : -8;
+            int to = pc.sq + dir;
+            int lastRank = pc.color==0 ? 7 : 0;
+            uint64_t targets = pawnAttacksBB(pc.color==0, 1ULL << pc.sq) & enemy;
+            if(!(occ >> to & 1)) targets |= 1ULL << to;
+            while(targets){
+                int t = popLsb(targets);
+                if((t >> 3) == lastRank){
+                    for(int promo : {QUEEN, ROOK, BISHOP, KNIGHT}) emit(i, t, promo, false);
+                }else emit(i, t, NO_TYPE, false);
+            }
+            int startRank = pc.color==0 ? 1 : 6;
+            if((pc.sq >> 3) == startRank && !(occ >> to & 1) && !(occ >> (to + dir) & 1))
+                emit(i, to + dir, NO_TYPE, true);
+        }else{
+            uint64_t targets = attacksFrom(pc.type, pc.color, pc.sq, occ) & ~own & (~occ | enemy);
+            while(targets) emit(i, popLsb(targets), NO_TYPE, false);
+        }
+    }
+}
+
+// 剛走棋那一方（!stm）的非吃子、非升變逆著：fn(parent, undoubledPush)
+template<class Fn>
+inline void forEachUnmove(const Board& b, Fn&& fn){
+    const uint64_t occ = b.occupied();
+    const int mover = b.stm ^ 1;
+    for(int i=0;i<b.n;i++){
+        const PieceSq& pc = b.p[i];
+        if(pc.color != mover) continue;
+        auto emit = [&](int from, bool dbl){
+            Board p = b;
+            p.p[i].sq = (int8_t)from;
+            p.stm = mover;
+            if(!inCheck(p, b.stm)) fn(p, dbl);
+        };
+        if(pc.type == PAWN){
+            int dir = pc.color==0 ? -8 : 8;
+            int from = pc.sq + dir;
+            int r = from >> 3;
+            if(r < 1 || r > 6 || (occ >> from & 1)) continue;
+            emit(from, false);
+            if(pc.color==0 ? (pc.sq >> 3) == 3 : (pc.sq >> 3) == 4){
+                int from2 = from + dir;
+                if(!(occ >> from2 & 1)) emit(from2, true);
+            }
+        }else{
+            uint64_t targets = attacksFrom(pc.type, pc.color, pc.sq, occ) & ~occ;
+            while(targets) emit(popLsb(targets), false);
+        }
+    }
+}
+
+// =========================
+// 記憶體映射檔（POSIX mmap / Windows MapViewOfFile）
+// =========================
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile(){ close(); }
+
+    const uint8_t* data() const{ return ptr; }
+    size_t size() const{ return len; }
+
+    bool open(const std::string& path){
+        close();
+#if defined(_WIN32)
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+        if(file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER sz;
+        if(!GetFileSizeEx(file, &sz) || sz.QuadPart == 0){ close(); return false; }
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if(!mapping){ close(); return false; }
+        ptr = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if(!ptr){ close(); return false; }
+        len = (size_t)sz.QuadPart;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0) return false;
+        struct stat st;
+        if(fstat(fd, &st) != 0 || st.st_size == 0){ ::close(fd); return false; }
+        void* m = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if(m == MAP_FAILED) return false;
+        madvise(m, (size_t)st.st_size, MADV_RANDOM);
+        ptr = static_cast<const uint8_t*>(m);
+        len = (size_t)st.st_size;
+#endif
+        return true;
+    }
+
+    void close(){
+#if defined(_WIN32)
+        if(ptr) UnmapViewOfFile(ptr);
+        if(mapping) CloseHandle(mapping);
+        if(file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if(ptr) munmap(const_cast<uint8_t*>(ptr), len);
+#endif
+        ptr = nullptr;
+        len = 0;
+    }
+
+private:
+    const uint8_t* ptr=nullptr;
+    size_t len=0;
+#if defined(_WIN32)
+    HANDLE file=INVALID_HANDLE_VALUE;
+    HANDLE mapping=nullptr;
+#endif
+};
+
+// =========================
+// 檔案格式與索引
+// =========================
+constexpr uint32_t FILE_MAGIC = 0x31425443;   // "CTB1"
+constexpr uint32_t FILE_VERSION = 1;
+constexpr uint32_t FLAG_ALL_DRAW = 1;         // 整張表都是和：只有檔頭
+
+struct FileHeader {
+    uint32_t magic=FILE_MAGIC;
+    uint32_t version=FILE_VERSION;
+    char name[16]{};
+    uint32_t pieces=0;
+    uint32_t flags=0;
+    uint64_t perSide=0;
+    uint64_t wdlOffset=0, dtmOffset=0;
+    uint32_t maxDtm=0;
+    uint32_t reserved=0;
+};
+
+// 白王三角 a1-d1-d4 的 10 格
+inline const int8_t* triangleIndex(){
+    static const struct T { int8_t idx[64]; T(){
+        int n = 0;
+        for(int sq=0;sq<64;sq++) idx[sq] = -1;
+        for(int r=0;r<4;r++) for(int f=r;f<4;f++) idx[r*8+f] = (int8_t)n++;
+    } } t;
+    return t.idx;
+}
+inline int triangleSquare(int i){
+    static const struct T { int8_t sq[10]; T(){
+        for(int s=0;s<64;s++) if(triangleIndex()[s] >= 0) sq[triangleIndex()[s]] = (int8_t)s;
+    } } t;
+    return t.sq[i];
+}
+
+inline char pieceLetter(int type){ return " PNBRQK"[type]; }
+
+struct Table {
+    std::string name;
+    int key=0;
+    int n=0;                        // 含兩個王
+    int8_t type[MAX_PIECES]{}, color[MAX_PIECES]{};   // 槽位：白王、黑王、白子（大到小）、黑子（大到小）
+    int lead=-1;                    // 領頭兵的槽位，-1 = 無兵表
+    uint64_t perSide=0;
+    bool allDraw=false;
+    uint32_t maxDtm=0;
+    const uint8_t* wdl=nullptr;
+    const uint8_t* dtm=nullptr;
+    MappedFile file;
+
+    // white / black：非王棋子型別（大到小），已確定白方為強方
+    void setMaterial(const std::vector<int>& white, const std::vector<int>& black){
+        n = 0;
+        type[n] = KING; color[n++] = 0;
+        type[n] = KING; color[n++] = 1;
+        for(int t : white){ type[n] = (int8_t)t; color[n++] = 0; }
+        for(int t : black){ type[n] = (int8_t)t; color[n++] = 1; }
+        name = "K";
+        for(int t : white) name += pieceLetter(t);
+        name += "vK";
+        for(int t : black) name += pieceLetter(t);
+        lead = -1;
+        for(int i=2;i<n && lead<0;i++) if(type[i]==PAWN) lead = i;
+        perSide = lead >= 0 ? 24 : 10;
+        for(int i=1;i<n;i++) perSide *= 64;
+        Board b;
+        b.n = n;
+        for(int i=0;i<n;i++) b.p[i] = PieceSq{type[i], color[i], 0};
+        key = materialKey(b);
+    }
+
+    size_t entries() const{ return (size_t)(2 * perSide); }
+
+    // b 已經是表的方向；回傳 entries() 範圍內的索引。
+    // 索引是唯一的：白王在對角線上（無兵表）或同型棋子互換時，各種寫法取最小的那個
+    uint64_t index(const Board& b) const{
+        int sq[MAX_PIECES];
+        bool used[MAX_PIECES] = {};
+        for(int s=0;s<n;s++){
+            for(int i=0;i<b.n;i++){
+                if(!used[i] && b.p[i].type==type[s] && b.p[i].color==color[s]){
+                    used[i] = true;
+                    sq[s] = b.p[i].sq;
+                    break;
+                }
+            }
+        }
+        uint64_t idx = ~0ULL;
+        if(lead >= 0){
+            for(int s=lead; s<n && type[s]==type[lead] && color[s]==color[lead]; s++){
+                int alt[MAX_PIECES];
+                std::copy(sq, sq+n, alt);
+                std::swap(alt[lead], alt[s]);
+                int mirror = (alt[lead] & 7) > 3 ? 7 : 0;
+                for(int k=0;k<n;k++) alt[k] ^= mirror;
+                idx = std::min(idx, pack(alt, lead, (uint64_t)(((alt[lead] >> 3) - 1) * 4 + (alt[lead] & 7))));
+            }
+        }else{
+            int flip = ((sq[0] & 7) > 3 ? 7 : 0) | ((sq[0] >> 3) > 3 ? 56 : 0);
+            for(int k=0;k<n;k++) sq[k] ^= flip;
+            int rank = sq[0] >> 3, file = sq[0] & 7;
+            int tr[MAX_PIECES];
+            for(int k=0;k<n;k++) tr[k] = ((sq[k] & 7) << 3) | (sq[k] >> 3);
+            if(rank <= file) idx = pack(sq, 0, (uint64_t)triangleIndex()[sq[0]]);
+            if(rank >= file) idx = std::min(idx, pack(tr, 0, (uint64_t)triangleIndex()[tr[0]]));
+        }
+        return (uint64_t)b.stm * perSide + idx;
+    }
+
+    // anchor 以外的槽位依序各佔 6 bits；同型同色的棋子先依格子排序
+    uint64_t pack(int* sq, int anchor, uint64_t idx) const{
+        for(int i=1;i<n;i++)
+            for(int j=i+1;j<n;j++)
+                if(i!=anchor && j!=anchor && type[i]==type[j] && color[i]==color[j] && sq[i] > sq[j])
+                    std::swap(sq[i], sq[j]);
+        for(int s=0;s<n;s++) if(s != anchor) idx = idx*64 + (uint64_t)sq[s];
+        return idx;
+    }
+
+    void decode(uint64_t idx, Board& b) const{
+        b.n = n;
+        b.stm = idx >= perSide;
+        idx %= perSide;
+        for(int s=n-1;s>=0;s--){
+            if(s == (lead >= 0 ? lead : 0)) continue;
+            b.p[s] = PieceSq{type[s], color[s], (int8_t)(idx % 64)};
+            idx /= 64;
+        }
+        int anchor = lead >= 0 ? lead : 0;
+        int sq = lead >= 0 ? (int)(idx/4 + 1) * 8 + (int)(idx%4) : triangleSquare((int)idx);
+        b.p[anchor] = PieceSq{type[anchor], color[anchor], (int8_t)sq};
+    }
+
+    // 不合法：重疊、兵在底線、不走的一方被將軍（含兩王相鄰）
+    static bool valid(const Board& b){
+        uint64_t occ = 0;
+        for(int i=0;i<b.n;i++){
+            uint64_t bit = 1ULL << b.p[i].sq;
+            if(occ & bit) return false;
+            occ |= bit;
+            if(b.p[i].type==PAWN && ((b.p[i].sq >> 3)==0 || (b.p[i].sq >> 3)==7)) return false;
+        }
+        return !inCheck(b, b.stm ^ 1);
+    }
+
+    uint8_t dtmAt(uint64_t idx) const{
+        return allDraw ? DRAW : dtm[idx];
+    }
+    int wdlAt(uint64_t idx) const{
+        if(allDraw) return 0;
+        int code = (wdl[idx >> 2] >> ((idx & 3) * 2)) & 3;
+        return code==1 ? 1 : code==2 ? -1 : 0;
+    }
+
+    bool open(const std::string& path){
+        wdl = dtm = nullptr;
+        allDraw = false;
+        if(!file.open(path)) return false;
+        if(!validate()){
+            file.close();
+            wdl = dtm = nullptr;
+            allDraw = false;
+            return false;
+        }
+        return true;
+    }
+
+    bool validate(){
+        FileHeader h;
+        if(file.size() < sizeof(h)) return false;
+        std::memcpy(&h, file.data(), sizeof(h));
+        if(h.magic != FILE_MAGIC || h.version != FILE_VERSION || name != std::string(h.name, strnlen(h.name, sizeof(h.name)))
+           || h.pieces != (uint32_t)n || h.perSide != perSide) return false;
+        allDraw = h.flags & FLAG_ALL_DRAW;
+        maxDtm = h.maxDtm;
+        if(!allDraw){
+            if(h.wdlOffset + (entries()+3)/4 > file.size() || h.dtmOffset + entries() > file.size()) return false;
+            wdl = file.data() + h.wdlOffset;
+            dtm = file.data() + h.dtmOffset;
+        }
+        return true;
+    }
+
+    // values：entries() 個 DTM byte
+    bool write(const std::string& path, const std::vector<uint8_t>& values){
+        FileHeader h;
+        std::strncpy(h.name, name.c_str(), sizeof(h.name) - 1);
+        h.pieces = (uint32_t)n;
+        h.perSide = perSide;
+        bool draw = true;
+        for(uint8_t v : values){
+            if(v != DRAW && v != INVALID){
+                draw = false;
+                h.maxDtm = std::max<uint32_t>(h.maxDtm, (uint32_t)dtmOf(v));
+            }
+        }
+        h.flags = draw ? FLAG_ALL_DRAW : 0;
+        std::vector<uint8_t> packed;
+        if(!draw){
+            packed.assign((values.size()+3)/4, 0);
+            for(size_t i=0;i<values.size();i++){
+                uint8_t v = values[i];
+                int code = v==INVALID ? 3 : isWin(v) ? 1 : isLoss(v) ? 2 : 0;
+                packed[i >> 2] |= (uint8_t)(code << ((i & 3) * 2));
+            }
+            h.wdlOffset = sizeof(h);
+            h.dtmOffset = (h.wdlOffset + packed.size() + 63) / 64 * 64;
+        }
+        FILE* f = std::fopen(path.c_str(), "wb");
+        if(!f) return false;
+        bool ok = std::fwrite(&h, sizeof(h), 1, f) == 1;
+        if(!draw){
+            ok = ok && std::fwrite(packed.data(), 1, packed.size(), f) == packed.size();
+            std::vector<uint8_t> pad(h.dtmOffset - h.wdlOffset - packed.size(), 0);
+            ok = ok && std::fwrite(pad.data(), 1, pad.size(), f) == pad.size();
+            ok = ok && std::fwrite(values.data(), 1, values.size(), f) == values.size();
+        }
+        return std::fclose(f) == 0 && ok;
+    }
+};
+
+// =========================
+// 整組表：依子力組成找表，查詢時自動翻轉顏色
+// =========================
+class TableSet {
+public:
+    struct Slot { Table* table=nullptr; bool flip=false; };
+
+    int maxPieces=0;
+
+    // 所有 <= pieces 子的組成（不含 KvK），依產生順序：子數少的先、兵少的先（吃子與升變都只依賴排在前面的表）
+    static std::vector<std::pair<std::vector<int>, std::vector<int>>> materials(int pieces){
+        std::vector<std::vector<int>> sides = {{}};
+        for(int a=QUEEN;a>=PAWN;a--){
+            sides.push_back({a});
+            for(int b2=a;b2>=PAWN;b2--) sides.push_back({a, b2});
+        }
+        std::vector<std::pair<std::vector<int>, std::vector<int>>> out;
+        for(const auto& w : sides) for(const auto& b : sides){
+            int n = 2 + (int)w.size() + (int)b.size();
+            if(n > pieces || n == 2 || !stronger(w, b)) continue;
+            out.push_back({w, b});
+        }
+        auto pawns = [](const std::pair<std::vector<int>, std::vector<int>>& m){
+            return (int)std::count(m.first.begin(), m.first.end(), PAWN)
+                 + (int)std::count(m.second.begin(), m.second.end(), PAWN);
+        };
+        std::stable_sort(out.begin(), out.end(), [&](const auto& x, const auto& y){
+            size_t nx = x.first.size() + x.second.size(), ny = y.first.size() + y.second.size();
+            return nx != ny ? nx < ny : pawns(x) < pawns(y);
+        });
+        return out;
+    }
+
+    // 白方是否算強方（子多的、同子數比最大的子）；相等也算，對稱組成不翻轉
+    static bool stronger(const std::vector<int>& w, const std::vector<int>& b){
+        if(w.size() != b.size()) return w.size() > b.size();
+        return !std::lexicographical_compare(w.begin(), w.end(), b.begin(), b.end());
+    }
+
+    Table& add(const std::vector<int>& white, const std::vector<int>& black){
+        tables.push_back(std::unique_ptr<Table>(new Table));
+        Table& t = *tables.back();
+        t.setMaterial(white, black);
+        slots[t.key] = Slot{&t, false};
+        Board flipped;
+        flipped.n = t.n;
+        for(int i=0;i<t.n;i++) flipped.p[i] = PieceSq{t.type[i], (int8_t)(t.color[i]^1), 0};
+        int fk = materialKey(flipped);
+        if(fk != t.key) slots[fk] = Slot{&t, true};
+        return t;
+    }
+
+    // 依組成把局面轉成表的方向；沒有這張表（或 KvK）時 table 為 nullptr
+    const Table* orient(Board& b) const{
+        const Slot& s = slots[materialKey(b)];
+        if(s.flip){
+            for(int i=0;i<b.n;i++){
+                b.p[i].color ^= 1;
+                b.p[i].sq ^= 56;
+            }
+            b.stm ^= 1;
+        }
+        return s.table && (s.table->allDraw || s.table->dtm) ? s.table : nullptr;
+    }
+
+    // 走子方視角的 DTM byte；KvK 為和。false = 沒有這張表
+    bool probeDtm(Board b, uint8_t& v) const{
+        if(b.n == 2){ v = DRAW; return true; }
+        const Table* t = orient(b);
+        if(!t) return false;
+        v = t->dtmAt(t->index(b));
+        return v != INVALID;
+    }
+
+    // 1 勝、0 和、-1 負（走子方）
+    bool probeWdl(Board b, int& wdl) const{
+        if(b.n == 2){ wdl = 0; return true; }
+        const Table* t = orient(b);
+        if(!t) return false;
+        uint64_t idx = t->index(b);
+        if(!t->allDraw && ((t->wdl[idx >> 2] >> ((idx & 3) * 2)) & 3) == 3) return false;
+        wdl = t->wdlAt(idx);
+        return true;
+    }
+
+    // dir 底下找得到的表全部映射進來；回傳張數
+    int load(const std::string& dir, int pieces=MAX_PIECES){
+        int found = 0;
+        for(const auto& m : materials(pieces)){
+            Table& t = add(m.first, m.second);
+            if(t.open(dir + "/" + t.name + ".ctb")){
+                found++;
+                maxPieces = std::max(maxPieces, t.n);
+            }
+        }
+        return found;
+    }
+
+    static std::shared_ptr<const TableSet> fromDir(const std::string& dir){
+        auto s = std::make_shared<TableSet>();
+        if(!s->load(dir)) return nullptr;
+        return s;
+    }
+
+private:
+    std::vector<std::unique_ptr<Table>> tables;
+    std::vector<Slot> slots = std::vector<Slot>(KEY_SPACE);
+};
+
+// =========================
+// 逆推產生器
+// =========================
+// 1) 初始：掃所有索引，標出不合法、將死（負 0）；只有吃子/升變可走的局面直接由子表定值，
+//    有吃子/升變能贏的記成種子（之後在對應 ply 才標，表內可能有更快的殺）。
+// 2) 依 ply n 由小到大：這一層定值的局面逐一逆走，
+//    - n 為負：前一手的局面都是勝（n+1）；
+//    - n 為勝：前一手的局面若所有著法都走到對手勝，就是負（最慢那步 + 1）。
+//    每層內多執行緒平行，標記用 CAS，新的局面先放各執行緒自己的桶，層結束才合併。
+// 過路兵：索引沒有過路兵權。走雙步造成對手可吃過路兵時，子局面的實際值另外算（吃掉後查子表）。
+struct GenStats {
+    uint64_t wins=0, draws=0, losses=0, invalid=0;
+    int maxDtm=0;
+};
+
+class Generator {
+public:
+    Generator(const TableSet& set, const Table& table, int threads)
+        : set(set), t(table), threads(std::max(1, threads)), values(new std::atomic<uint8_t>[table.entries()]) {}
+
+    GenStats run(std::vector<uint8_t>& out){
+        const size_t N = t.entries();
+        for(size_t i=0;i<N;i++) values[i].store(DRAW, std::memory_order_relaxed);
+        buckets.assign(MAX_DTM+3, {});
+        seeds.assign(MAX_DTM+3, {});
+
+        parallel(N, [&](size_t i, Local& loc){ init(i, loc); });
+        for(int n=0; n<=MAX_DTM; n++){
+            std::vector<uint32_t> frontier;
+            frontier.swap(buckets[n]);
+            for(uint32_t s : seeds[n]){
+                uint8_t expect = DRAW;
+                if(values[s].compare_exchange_strong(expect, encodeDtm(n))) frontier.push_back(s);
+            }
+            seeds[n].clear();
+            if(!frontier.empty())
+                parallel(frontier.size(), [&](size_t k, Local& loc){ retro(frontier[k], n, loc); });
+            bool pending = false;
+            for(int m=n+1; m<=MAX_DTM && !pending; m++) pending = !buckets[m].empty() || !seeds[m].empty();
+            if(!pending) break;
+        }
+
+        GenStats st;
+        out.resize(N);
+        for(size_t i=0;i<N;i++){
+            uint8_t v = values[i].load(std::memory_order_relaxed);
+            out[i] = v;
+            if(v == INVALID) st.invalid++;
+            else if(isWin(v)) st.wins++;
+            else if(isLoss(v)) st.losses++;
+            else st.draws++;
+            if(v != INVALID && v != DRAW) st.maxDtm = std::max(st.maxDtm, dtmOf(v));
+        }
+        return st;
+    }
+
+private:
+    struct Local {
+        std::vector<std::vector<uint32_t>> buckets = std::vector<std::vector<uint32_t>>(MAX_DTM+3);
+        std::vector<std::vector<uint32_t>> seeds = std::vector<std::vector<uint32_t>>(MAX_DTM+3);
+    };
+
+    const TableSet& set;
+    const Table& t;
+    int threads;
+    std::unique_ptr<std::atomic<uint8_t>[]> values;
+    std::vector<std::vector<uint32_t>> buckets, seeds;
+
+    // 每個執行緒拿交錯的區塊；結束後把各自的桶併回來
+    template<class Fn>
+    void parallel(size_t n, Fn&& fn){
+        const size_t CHUNK = 4096;
+        std::atomic<size_t> next{0};
+        std::vector<Local> locals(threads);
+        auto worker = [&](int id){
+            for(size_t b; (b = next.fetch_add(CHUNK)) < n; )
+                for(size_t i=b; i<std::min(n, b+CHUNK); i++) fn(i, locals[id]);
+        };
+        std::vector<std::thread> pool;
+        for(int i=1;i<threads;i++) pool.emplace_back(worker, i);
+        worker(0);
+        for(auto& th : pool) th.join();
+        for(Local& loc : locals){
+            for(int d=0; d<=MAX_DTM+2; d++){
+                buckets[d].insert(buckets[d].end(), loc.buckets[d].begin(), loc.buckets[d].end());
+                seeds[d].insert(seeds[d].end(), loc.seeds[d].begin(), loc.seeds[d].end());
+            }
+        }
+    }
+
+    // 子局面（走子方 = 對手）的值：表內讀進行中的陣列，吃子/升變查子表
+    uint8_t childValue(const Board& c, bool conversion) const{
+        if(!conversion) return values[t.index(c)].load(std::memory_order_relaxed);
+        uint8_t v = DRAW;
+        set.probeDtm(c, v);
+        return v;
+    }
+
+    // 雙步之後對手能吃過路兵時，吃掉後局面的值（對手視角的「吃」這步：回傳吃完後、輪到我們的 DTM byte）。
+    // 沒有合法的過路兵吃法回傳 false
+    bool epReply(const Board& c, int pushedSq, uint8_t& afterEp) const{
+        const int opp = c.stm;
+        bool found = false;
+        int best = -1000000;
+        for(int i=0;i<c.n;i++){
+            const PieceSq& pc = c.p[i];
+            if(pc.color != opp || pc.type != PAWN) continue;
+            if((pc.sq >> 3) != (pushedSq >> 3) || std::abs((pc.sq & 7) - (pushedSq & 7)) != 1) continue;
+            Board e = c;
+            int victim = e.at(pushedSq);
+            e.p[i].sq = (int8_t)(pushedSq + (opp==0 ? 8 : -8));
+            e.remove(victim);
+            e.stm ^= 1;
+            if(inCheck(e, opp)) continue;
+            uint8_t v = DRAW;
+            set.probeDtm(e, v);
+            // 對手挑對自己最好的：我們負得越快越好，其次和，最後我們勝得越慢越好
+            int score = isLoss(v) ? 1000 - dtmOf(v) : isWin(v) ? -1000 + dtmOf(v) : 0;
+            if(!found || score > best){
+                best = score;
+                afterEp = v;
+                found = true;
+            }
+        }
+        return found;
+    }
+
+    // 雙步子局面的實際值（走子方 = 對手）：表內值和吃過路兵取對手較好的
+    uint8_t effectiveChild(const Board& c, bool doublePush, int pushedSq, uint8_t v) const{
+        if(!doublePush) return v;
+        uint8_t afterEp;
+        if(!epReply(c, pushedSq, afterEp)) return v;
+        uint8_t viaEp = isLoss(afterEp) ? encodeDtm(dtmOf(afterEp)+1)
+                      : isWin(afterEp) ? encodeDtm(dtmOf(afterEp)+1) : DRAW;
+        auto score = [](uint8_t x){ return isWin(x) ? 1000 - dtmOf(x) : isLoss(x) ? -1000 + dtmOf(x) : 0; };
+        return score(viaEp) > score(v) ? viaEp : v;
+    }
+
+    static int pushedSquare(const Board& parent, const Board& child){
+        for(int i=0;i<child.n;i++)
+            if(child.p[i].type==PAWN && child.p[i].sq != parent.p[i].sq) return child.p[i].sq;
+        return -1;
+    }
+
+    void init(size_t idx, Local& loc){
+        Board b;
+        t.decode(idx, b);
+        // 對稱的另一種寫法只存一份：不是標準索引的格子當作不合法
+        if(!Table::valid(b) || t.index(b) != idx){
+            values[idx].store(INVALID, std::memory_order_relaxed);
+            return;
+        }
+        int legal = 0, inTable = 0;
+        int bestWin = -1, worstLoss = -1;
+        bool convDraw = false;
+        forEachMove(b, [&](const Board& c, bool conv, bool){
+            legal++;
+            if(!conv){ inTable++; return; }
+            uint8_t v = childValue(c, true);
+            if(isLoss(v)) bestWin = bestWin < 0 ? dtmOf(v)+1 : std::min(bestWin, dtmOf(v)+1);
+            else if(isWin(v)) worstLoss = std::max(worstLoss, dtmOf(v)+1);
+            else convDraw = true;
+        });
+        if(!legal){
+            if(inCheck(b, b.stm)){
+                values[idx].store(encodeDtm(0), std::memory_order_relaxed);
+                loc.buckets[0].push_back((uint32_t)idx);
+            }
+            return;
+        }
+        if(bestWin > MAX_DTM || worstLoss > MAX_DTM) return;
+        if(!inTable){
+            int d = bestWin >= 0 ? bestWin : convDraw ? -1 : worstLoss;
+            if(d >= 0){
+                values[idx].store(encodeDtm(d), std::memory_order_relaxed);
+                loc.buckets[d].push_back((uint32_t)idx);
+            }
+            return;
+        }
+        if(bestWin >= 0) loc.seeds[bestWin].push_back((uint32_t)idx);
+    }
+
+    // 所有著法都走到對手勝？是的話回傳最慢的那個 DTM + 1，否則 -1
+    int allMovesLose(const Board& p) const{
+        int worst = -1;
+        bool ok = true, any = false;
+        forEachMove(p, [&](const Board& c, bool conv, bool dbl){
+            if(!ok) return;
+            any = true;
+            uint8_t v = childValue(c, conv);
+            if(dbl) v = effectiveChild(c, true, pushedSquare(p, c), v);
+            if(!isWin(v)){ ok = false; return; }
+            worst = std::max(worst, dtmOf(v) + 1);
+        });
+        return ok && any ? worst : -1;
+    }
+
+    void retro(uint32_t idx, int n, Local& loc){
+        Board c;
+        t.decode(idx, c);
+        const bool childLoses = !(n & 1);
+        forEachUnmove(c, [&](const Board& p, bool dbl){
+            uint64_t pi = t.index(p);
+            if(values[pi].load(std::memory_order_relaxed) != DRAW) return;
+            if(childLoses){
+                int d = n + 1;
+                if(dbl){
+                    // 對手也許能吃過路兵逃掉，或拖得更久
+                    uint8_t eff = effectiveChild(c, true, pushedSquare(p, c), encodeDtm(n));
+                    if(!isLoss(eff)) return;
+                    d = dtmOf(eff) + 1;
+                    if(d > n + 1){
+                        if(d <= MAX_DTM) loc.seeds[d].push_back((uint32_t)pi);
+                        return;
+                    }
+                }
+                uint8_t expect = DRAW;
+                if(values[pi].compare_exchange_strong(expect, encodeDtm(d))) loc.buckets[d].push_back((uint32_t)pi);
+            }else{
+                int d = allMovesLose(p);
+                if(d < 0 || d > MAX_DTM) return;
+                uint8_t expect = DRAW;
+                if(values[pi].compare_exchange_strong(expect, encodeDtm(d))) loc.buckets[d].push_back((uint32_t)pi);
+            }
+        });
+    }
+};
+
+// dir 底下缺的表依序產生並寫檔，已有的直接映射；每張表完成後 report(table, stats, seconds, generated)
+template<class Report>
+inline bool generateTables(TableSet& set, const std::string& dir, int pieces, int threads, Report&& report){
+    for(const auto& m : TableSet::materials(std::min(pieces, MAX_PIECES))){
+        Table& t = set.add(m.first, m.second);
+        const std::string path = dir + "/" + t.name + ".ctb";
+        GenStats st;
+        double sec = 0;
+        bool generated = !t.open(path);
+        if(generated){
+            auto t0 = std::chrono::steady_clock::now();
+            std::vector<uint8_t> values;
+            st = Generator(set, t, threads).run(values);
+            if(!t.write(path, values) || !t.open(path)) return false;
+            sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        }
+        set.maxPieces = std::max(set.maxPieces, t.n);
+        report(t, st, sec, generated);
+    }
+    return true;
+}
+
+} // namespace tb
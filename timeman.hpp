@@ -0,0 +1,87 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+// =========================
+// 搜尋限制（對應 UCI go 的參數）
+// =========================
+struct SearchLimits {
+    int depth=0;                 // 0 = 不限（由時間決定）
+    int64_t time[2]{0,0};        // [0]=白 wtime, [1]=黑 btime（毫秒）
+    int64_t inc[2]{0,0};         // winc / binc
+    int movestogo=0;
+    int64_t movetime=0;
+    uint64_t nodes=0;            // 節點預算（所有執行緒合計），0 = 不限
+    int mate=0;                  // go mate N：找到 N 步內的殺就停
+    bool infinite=false;         // go infinite：只靠 stop 結束
+    bool ponder=false;           // go ponder：ponderhit 之前不計時停止
+
+    bool useTimeManagement() const{ return time[0] || time[1]; }
+};
+
+// =========================
+// 時間管理：soft / hard 上限
+// =========================
+// optimum（soft）：一輪迭代結束後超過它就不再開下一輪；最佳著穩定時會再打折。
+// maximum（hard）：搜尋中每 TIME_CHECK_NODES 個節點檢查一次，超過就立刻停。
+// 參考 stockfish/src/timeman.cpp 的介面，公式簡化成固定的 moves-to-go 視野。
+struct TimeManager {
+    using Clock = std::chrono::steady_clock;
+    static constexpr uint64_t TIME_CHECK_NODES = 1024;   // 必須是 2 的冪
+
+    Clock::time_point start = Clock::now();
+    int64_t optimumMs=0;
+    int64_t maximumMs=0;
+    bool active=false;        // false = 沒有時間限制（depth / infinite）
+    bool fixedTime=false;     // movetime：用滿，不提早收手
+
+    void init(const SearchLimits& lim, bool white, int64_t moveOverhead){
+        start = Clock::now();
+        active = false;
+        fixedTime = false;
+
+        if(lim.movetime > 0){
+            active = true;
+            fixedTime = true;
+            optimumMs = maximumMs = std::max<int64_t>(1, lim.movetime - moveOverhead);
+            return;
+        }
+        if(!lim.useTimeManagement()) return;
+
+        int us = white ? 0 : 1;
+        int64_t myTime = lim.time[us];
+        int64_t myInc  = lim.inc[us];
+        active = true;
+
+        // 沒給 movestogo（sudden death）就假設還要走 40 步
+        int mtg = lim.movestogo ? std::min(lim.movestogo, 50) : 40;
+
+        // 這一步之後剩下的可支配時間，每一步都先扣掉通訊延遲
+        int64_t timeLeft = std::max<int64_t>(1, myTime + myInc * (mtg - 1) - moveOverhead * (2 + mtg));
+
+        optimumMs = timeLeft / mtg;
+        if(lim.movestogo == 1) optimumMs = timeLeft * 8 / 10;
+
+        // hard 上限：optimum 的數倍，但絕不超過剩餘時鐘的 80%
+        int64_t cap = myTime * 8 / 10 - moveOverhead;
+        maximumMs = std::min<int64_t>(optimumMs * 5, cap);
+        maximumMs = std::max<int64_t>(1, maximumMs);
+        optimumMs = std::max<int64_t>(1, std::min(optimumMs, maximumMs));
+    }
+
+    int64_t elapsed() const{
+        return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+    }
+
+    // 一輪迭代結束後呼叫：stableIters = 最佳著連續幾輪沒變
+    bool softStop(int stableIters) const{
+        if(!active || fixedTime) return false;
+        double scale = std::max(0.5, 1.4 - 0.2 * stableIters);
+        return elapsed() >= (int64_t)(optimumMs * scale);
+    }
+
+    bool hardStop() const{
+        return active && elapsed() >= maximumMs;
+    }
+};
@@ -9,15 +9,21 @@
 #include <algorithm>
 #include <fstream>
 #include <string>
+#include <sstream>
+#include <chrono>
+#include <thread>
+#include <array>
 
 // =========================
 // Game / Match
 // =========================
 
 // 回傳：+1 白勝，0 和局，-1 黑勝
-static int playGame(Engine white, Engine black, int depth, int maxPlies, std::mt19937& rng){
+// nodes>0：固定節點數對局（每步成本一致，吞吐量可預期）
+static int playGame(Engine white, Engine black, int depth, uint64_t nodes, int maxPlies, std::mt19937& rng){
   Position pos;
   pos.setStartPos();
+  white.attachPsq(pos);   // 每步裁決用白方的 eval：子力 + PST 增量維護，不必每步掃盤面
 
   const int RANDOM_OPENING_PLIES = 4; // 破對稱
   double eps = 0.15;                  // 探索
@@ -27,7 +33,8 @@ static int playGame(Engine white, Engine black, int depth, int maxPlies, std::mt
     pos.genLegalMoves(moves);
 
     if(moves.empty()){
-      // 輪到走的人無子可走 -> 輸（簡化）
+      // 被將死 -> 輸；逼和 -> 和局
+      if(!pos.isInCheck(pos.whiteToMove)) return 0;
       return pos.whiteToMove ? -1 : +1;
     }
 
@@ -37,14 +44,14 @@ static int playGame(Engine white, Engine black, int depth, int maxPlies, std::mt
       m = moves[I(rng)];
     }else{
       Engine& side = pos.whiteToMove ? white : black;
-      m = side.bestMove(pos, depth, eps, &rng);
+      m = side.bestMove(pos, nodes ? 0 : depth, eps, &rng, nodes);
     }
 
     Undo u;
     pos.makeMove(m, u);
 
     // 提早裁決：eval 差距大就判勝負（加速）
-    int sc = white.eval(pos); // 白方視角
+    int sc = white.evalCached(pos); // 白方視角
     if (sc > 200) return +1;
     if (sc < -200) return -1;
 
@@ -53,7 +60,7 @@ static int playGame(Engine white, Engine black, int depth, int maxPlies, std::mt
   }
 
   // 走滿：用 eval 裁決
-  int sc = white.eval(pos);
+  int sc = white.evalCached(pos);
     if (sc > 30) return +1;
     if (sc < -30) return -1;
 
@@ -63,18 +70,18 @@ static int playGame(Engine white, Engine black, int depth, int maxPlies, std::mt
 
 // wA vs wB 多盤，回傳 A 的平均得分（勝=1 和=0.5 負=0）
 static double matchScore(const Weights& wA, const Weights& wB,
-                         int games, int depth, std::mt19937& rng){
+                         int games, int depth, uint64_t nodes, std::mt19937& rng){
   double sum = 0.0;
 
   for(int i=0; i<games; i++){
-    Engine A; A.w = wA;
-    Engine B; B.w = wB;
+    Engine A; A.setWeights(wA);
+    Engine B; B.setWeights(wB);
 
     bool AisWhite = (i % 2 == 0);
 
     int resultWhite = AisWhite
-      ? playGame(A, B, depth, 220, rng)
-      : playGame(B, A, depth, 220, rng);
+      ? playGame(A, B, depth, nodes, 220, rng)
+      : playGame(B, A, depth, nodes, 220, rng);
 
     double ptsA = 0.5;
     if(resultWhite == +1) ptsA = AisWhite ? 1.0 : 0.0;
@@ -90,42 +97,41 @@ static double matchScore(const Weights& wA, const Weights& wB,
 // ParamView
 // =========================
 struct ParamView {
-  static constexpr int N = 6 + 64 + 64;
+  // 參數個數與順序都照 Weights::forEachParam，新增參數不必改這裡
+  static size_t size(){
+    Weights w;
+    size_t n = 0;
+    w.forEachParam([&](const char*, double*, int count, const ParamBounds&){ n += count; });
+    return n;
+  }
 
-  static std::vector<double> flatten(const Weights& w){
-    std::vector<double> x; x.reserve(N);
-    for(int i=0;i<6;i++)   x.push_back((double)w.material[i]);
-    for(int i=0;i<64;i++)  x.push_back((double)w.pstPawn[i]);
-    for(int i=0;i<64;i++)  x.push_back((double)w.pstKnight[i]);
+  static std::vector<double> flatten(const Weights& src){
+    Weights w = src;
+    std::vector<double> x; x.reserve(size());
+    w.forEachParam([&](const char*, double* v, int count, const ParamBounds&){
+      x.insert(x.end(), v, v + count);
+    });
     return x;
   }
 
   static Weights unflatten(const std::vector<double>& x, const Weights& base){
     Weights w = base;
-    int idx=0;
-
-    for(int i=0;i<6;i++)   w.material[i]  = (int)llround(x[idx++]);
-    for(int i=0;i<64;i++)  w.pstPawn[i]   = (int)llround(x[idx++]);
-    for(int i=0;i<64;i++)  w.pstKnight[i] = (int)llround(x[idx++]);
+    size_t idx=0;
 
     auto clampd = [&](double& v, double lo, double hi){
         if(v < lo) v = lo;
         if(v > hi) v = hi;
     };
 
-    // material clamp
-    clampd(w.material[0], 60, 200);
-    clampd(w.material[1], 200, 500);
-    clampd(w.material[2], 200, 500);
-    clampd(w.material[3], 300, 800);
-    clampd(w.material[4], 600, 1500);
-    w.material[5] = 0;
-
-    // pst clamp
-    for(int i=0;i<64;i++){
-      clampd(w.pstPawn[i],   -80, 120);
-      clampd(w.pstKnight[i], -120, 120);
-    }
+    // 範圍全部來自 forEachParam（含子力各棋子的範圍、王與通路兵 rank 1/8 固定為 0）
+    w.forEachParam([&](const char*, double* v, int count, const ParamBounds& b){
+      for(int i=0;i<count;i++){
+        v[i] = (int)llround(x[idx++]);
+        clampd(v[i], b.lo(i), b.hi(i));
+      }
+    });
+
+    w.compile();
     return w;
   }
 };
@@ -162,12 +168,880 @@ static std::pair<double,double> minmaxArr(const double* a, int n){
 }
 
 
-// ========================='
+// =========================
+// NNUE 訓練（trainer nnue）
+// =========================
+// 資料集：每行一個 FEN 加上對局結果（白方視角）。結果可寫成 1-0 / 0-1 / 1/2-1/2、[1.0] / [0.5] / [0.0]、
+// 「| 0.5」、EPD 的 c9 "1-0";，或行尾單獨的數字。只留下棋子位置與走子方，打包成稀疏輸入。
+struct PackedSample {
+  uint16_t pieces[32];   // (pc << 6) | sq
+  uint8_t count = 0;
+  uint8_t whiteToMove = 1;
+  float result = 0.5f;
+};
+
+static std::array<Piece,64> unpackBoard(const PackedSample& s){
+  std::array<Piece,64> b{};
+  for(int k=0; k<s.count; k++) b[s.pieces[k] & 63] = (Piece)(s.pieces[k] >> 6);
+  return b;
+}
+
+static std::string stripPunct(std::string tok){
+  tok.erase(std::remove_if(tok.begin(), tok.end(),
+            [](char c){ return c=='"' || c==';' || c=='[' || c==']' || c==','; }), tok.end());
+  return tok;
+}
+
+static bool parseGameResult(const std::string& tok, float& r){
+  if(tok=="1-0"){ r = 1.0f; return true; }
+  if(tok=="0-1"){ r = 0.0f; return true; }
+  if(tok=="1/2-1/2"){ r = 0.5f; return true; }
+  return false;
+}
+
+// 結果的值：1-0 / 0-1 / 1/2-1/2 或 [0, 1] 的數字（引號、分號、方括號已去掉）
+static bool parseResultToken(std::string tok, float& r){
+  tok = stripPunct(tok);
+  if(parseGameResult(tok, r)) return true;
+  char* end = nullptr;
+  double v = std::strtod(tok.c_str(), &end);
+  if(tok.empty() || *end || v < 0.0 || v > 1.0) return false;
+  r = (float)v;
+  return true;
+}
+
+static bool isInteger(const std::string& s){
+  return !s.empty() && std::all_of(s.begin(), s.end(), [](char c){ return c>='0' && c<='9'; });
+}
+
+static bool parseSample(const std::string& line, PackedSample& s){
+  std::istringstream ss(line);
+  std::vector<std::string> tok;
+  for(std::string t; ss >> t; ) tok.push_back(t);
+  if(tok.size() < 5) return false;
+
+  // FEN 可能帶 halfmove / fullmove 兩個整數，結果要從它們後面找。
+  // 只認明確的寫法：c9 "…" 的運算元、[x]、| x、1-0 / 0-1 / 1/2-1/2；純數字只在它是最後一個 token
+  // 而且不是 opcode 運算元（沒有分號）時才算，hmvc 0; / acd 1; 之類不能當成結果
+  size_t first = (tok.size() >= 7 && isInteger(tok[4]) && isInteger(tok[5])) ? 6 : 4;
+  bool found = false;
+  for(size_t i = first; i+1 < tok.size() && !found; i++)
+    if(tok[i] == "c9") found = parseResultToken(tok[i+1], s.result);
+  for(size_t i = tok.size(); i-- > first && !found; ){
+    const std::string& t = tok[i];
+    std::string bare = t;
+    while(!bare.empty() && (bare.back()==';' || bare.back()==',')) bare.pop_back();
+    if(bare.size() > 2 && bare.front()=='[' && bare.back()==']') found = parseResultToken(bare, s.result);
+    else if(t == "|" && i+1 < tok.size()) found = parseResultToken(tok[i+1], s.result);
+    else if(parseGameResult(stripPunct(t), s.result)) found = true;
+    else if(i+1 == tok.size() && t.find(';') == std::string::npos && t[0] != '"') found = parseResultToken(t, s.result);
+  }
+  if(!found) return false;
+
+  Position pos;
+  pos.setFEN(tok[0] + " " + tok[1] + " " + tok[2] + " " + tok[3] + " 0 1");
+  s.count = 0;
+  s.whiteToMove = pos.whiteToMove;
+  for(int sq=0; sq<64; sq++){
+    if(pos.b[sq] == EMPTY) continue;
+    if(s.count == 32) return false;
+    s.pieces[s.count++] = (uint16_t)(pos.b[sq] << 6 | sq);
+  }
+  return pos.kingSq[0] >= 0 && pos.kingSq[1] >= 0;
+}
+
+static bool loadDataset(const std::string& path, std::vector<PackedSample>& out, size_t& skipped){
+  std::ifstream in(path);
+  if(!in) return false;
+  skipped = 0;
+  std::string line;
+  while(std::getline(in, line)){
+    if(line.empty() || line[0] == '#') continue;
+    PackedSample s;
+    if(parseSample(line, s)) out.push_back(s);
+    else skipped++;
+  }
+  return true;
+}
+
+// 把 [0, n) 切給 threads 條執行緒：f(begin, end, tid)
+template<class F>
+static void parallelFor(size_t n, int threads, F&& f){
+  std::vector<std::thread> pool;
+  size_t chunk = (n + threads - 1) / threads;
+  for(int t=0; t<threads; t++){
+    size_t b = std::min(n, t*chunk), e = std::min(n, b + chunk);
+    if(b >= e) break;
+    pool.emplace_back([&f, b, e, t]{ f(b, e, t); });
+  }
+  for(auto& th : pool) th.join();
+}
+
+// 浮點網路：所有參數攤平成一個向量（優化器只看得到一串數字），量化後就是引擎讀的 .nnue
+// 網路輸出 y 對應 y * NNUE_SCALE centipawn；勝率 = sigmoid(cp / NNUE_WDL_CP)
+namespace nnue_train {
+
+constexpr int H = NNUE_HIDDEN;
+constexpr size_t FT = 0;
+constexpr size_t FT_BIAS = (size_t)NNUE_INPUTS * H;
+constexpr size_t OUT = FT_BIAS + H;
+constexpr size_t OUT_BIAS = OUT + 2*H;
+constexpr size_t SIZE = OUT_BIAS + 1;
+constexpr float NNUE_WDL_CP = 160.0f;
+constexpr float WDL_K = NNUE_SCALE / NNUE_WDL_CP;
+
+inline float sigmoid(float x){ return 1.0f / (1.0f + std::exp(-x)); }
+inline float crelu(float x){ return std::min(std::max(x, 0.0f), 1.0f); }
+
+// 走子方視角的目標勝率
+inline float target(const PackedSample& s){ return s.whiteToMove ? s.result : 1.0f - s.result; }
+
+// acc[0] = 走子方視角、acc[1] = 對手視角；feat 記下兩邊的輸入編號給反向傳播用
+inline float forward(const float* P, const PackedSample& s, float (*acc)[H], int (*feat)[32]){
+  int us = s.whiteToMove ? 0 : 1;
+  float y = P[OUT_BIAS];
+  for(int side=0; side<2; side++){
+    float* a = acc[side];
+    std::copy(P + FT_BIAS, P + FT_BIAS + H, a);
+    for(int k=0; k<s.count; k++){
+      int f = nnueFeature(us ^ side, s.pieces[k] >> 6, s.pieces[k] & 63);
+      feat[side][k] = f;
+      const float* w = P + FT + (size_t)f * H;
+      for(int i=0; i<H; i++) a[i] += w[i];
+    }
+    const float* wo = P + OUT + side * H;
+    for(int i=0; i<H; i++) y += crelu(a[i]) * wo[i];
+  }
+  return y;
+}
+
+// MSE(sigmoid(y), target)；梯度累加進 G，touched 標出這批用到的輸入列（歸約時只加這些列）
+inline float backward(const float* P, float* G, uint8_t* touched, const PackedSample& s){
+  float acc[2][H];
+  int feat[2][32];
+  float p = sigmoid(forward(P, s, acc, feat) * WDL_K), t = target(s);
+  float dy = 2.0f * (p - t) * p * (1.0f - p) * WDL_K;
+  G[OUT_BIAS] += dy;
+  for(int side=0; side<2; side++){
+    const float* wo = P + OUT + side * H;
+    float* go = G + OUT + side * H;
+    float dAcc[H];
+    for(int i=0; i<H; i++){
+      float a = acc[side][i];
+      go[i] += dy * crelu(a);
+      dAcc[i] = (a > 0.0f && a < 1.0f) ? dy * wo[i] : 0.0f;
+      G[FT_BIAS + i] += dAcc[i];
+    }
+    for(int k=0; k<s.count; k++){
+      int f = feat[side][k];
+      touched[f] = 1;
+      float* g = G + FT + (size_t)f * H;
+      for(int i=0; i<H; i++) g[i] += dAcc[i];
+    }
+  }
+  return (p - t) * (p - t);
+}
+
+inline int16_t q16(float v, float scale){
+  return (int16_t)std::max(-32767L, std::min(32767L, std::lround(v * scale)));
+}
+
+inline void quantize(const std::vector<float>& P, NnueNetwork& net){
+  for(int f=0; f<NNUE_INPUTS; f++)
+    for(int i=0; i<H; i++) net.ftWeights[f][i] = q16(P[FT + (size_t)f*H + i], NNUE_QA);
+  for(int i=0; i<H; i++) net.ftBias[i] = q16(P[FT_BIAS + i], NNUE_QA);
+  for(int i=0; i<2*H; i++) net.outWeights[i] = q16(P[OUT + i], NNUE_QB);
+  net.outBias = (int32_t)std::lround(P[OUT_BIAS] * NNUE_QA * NNUE_QB);
+}
+
+inline void dequantize(const NnueNetwork& net, std::vector<float>& P){
+  for(int f=0; f<NNUE_INPUTS; f++)
+    for(int i=0; i<H; i++) P[FT + (size_t)f*H + i] = net.ftWeights[f][i] / (float)NNUE_QA;
+  for(int i=0; i<H; i++) P[FT_BIAS + i] = net.ftBias[i] / (float)NNUE_QA;
+  for(int i=0; i<2*H; i++) P[OUT + i] = net.outWeights[i] / (float)NNUE_QB;
+  P[OUT_BIAS] = net.outBias / (float)(NNUE_QA * NNUE_QB);
+}
+
+} // namespace nnue_train
+
+// 用法：trainer nnue <dataset> [epochs] [threads] [out.nnue] [adam|sgd] [lr] [batch]
+// 最後 5% 當驗證集；每個 epoch 結束都量化存檔（out 已存在且格式相符就從它接著訓練）
+static int runNnueTraining(int argc, char** argv){
+  using namespace nnue_train;
+  if(argc < 3){
+    std::cerr << "usage: trainer nnue <dataset> [epochs] [threads] [out.nnue] [adam|sgd] [lr] [batch]\n";
+    return 1;
+  }
+  std::string dataPath = argv[2];
+  int epochs      = argc >= 4 ? std::max(1, std::atoi(argv[3])) : 10;
+  int threads     = argc >= 5 ? std::max(1, std::atoi(argv[4])) : (int)std::max(1u, std::thread::hardware_concurrency());
+  std::string out = argc >= 6 ? argv[5] : "net.nnue";
+  bool adam       = argc >= 7 ? std::string(argv[6]) != "sgd" : true;
+  float lr        = argc >= 8 ? (float)std::atof(argv[7]) : (adam ? 0.001f : 0.02f);
+  size_t batch    = argc >= 9 ? (size_t)std::max(1, std::atoi(argv[8])) : 16384;
+
+  std::vector<PackedSample> data;
+  size_t skipped = 0;
+  if(!loadDataset(dataPath, data, skipped)){
+    std::cerr << "Cannot open dataset " << dataPath << "\n";
+    return 1;
+  }
+  if(data.size() < 20){
+    std::cerr << "Dataset too small (" << data.size() << " positions)\n";
+    return 1;
+  }
+
+  std::mt19937 rng(12345);
+  std::shuffle(data.begin(), data.end(), rng);
+  size_t nVal = data.size() / 20;
+  std::vector<PackedSample> val(data.end() - nVal, data.end());
+  data.resize(data.size() - nVal);
+
+  std::vector<float> P(SIZE);
+  auto net = std::make_unique<NnueNetwork>();
+  if(net->load(out)){
+    dequantize(*net, P);
+    std::cout << "[Resume] Loaded " << out << "\n";
+  }else{
+    std::normal_distribution<float> ftInit(0.0f, 0.05f), outInit(0.0f, 1.0f / std::sqrt(2.0f * H));
+    for(size_t i=FT; i<FT_BIAS; i++) P[i] = ftInit(rng);
+    for(size_t i=FT_BIAS; i<OUT; i++) P[i] = 0.25f;
+    for(size_t i=OUT; i<OUT_BIAS; i++) P[i] = outInit(rng);
+  }
+
+  std::cout << "NNUE training start\n";
+  std::cout << "dataset=" << dataPath << " train=" << data.size() << " val=" << val.size()
+            << " skipped=" << skipped << "\n";
+  std::cout << "epochs=" << epochs << " threads=" << threads << " optimizer=" << (adam ? "adam" : "sgd")
+            << " lr=" << lr << " batch=" << batch << " hidden=" << H << " out=" << out << "\n";
+
+  // 每條執行緒自己一份梯度，批次結束再歸約；輸入層只加被碰到的列
+  std::vector<std::vector<float>> grads(threads, std::vector<float>(SIZE, 0.0f));
+  std::vector<std::vector<uint8_t>> touched(threads, std::vector<uint8_t>(NNUE_INPUTS, 0));
+  std::vector<double> lossSum(threads);
+  std::vector<float> G(SIZE), M(SIZE), V(SIZE);
+  const float beta1 = 0.9f, beta2 = 0.999f, eps = 1e-8f;
+  long step = 0;
+
+  auto valLoss = [&](bool quantized){
+    std::vector<double> part(threads, 0.0);
+    if(quantized) quantize(P, *net);
+    parallelFor(val.size(), threads, [&](size_t b, size_t e, int tid){
+      float acc[2][H];
+      int feat[2][32];
+      for(size_t i=b; i<e; i++){
+        float y = quantized ? nnueEvaluateFull(*net, unpackBoard(val[i]), val[i].whiteToMove) / NNUE_WDL_CP
+                            : forward(P.data(), val[i], acc, feat) * WDL_K;
+        float d = sigmoid(y) - target(val[i]);
+        part[tid] += d * d;
+      }
+    });
+    double sum = 0;
+    for(double v : part) sum += v;
+    return sum / val.size();
+  };
+
+  std::cout << "epoch 0 val_loss=" << std::fixed << std::setprecision(6) << valLoss(false) << "\n";
+
+  for(int ep=1; ep<=epochs; ep++){
+    std::shuffle(data.begin(), data.end(), rng);
+    auto t0 = std::chrono::steady_clock::now();
+    double trainLoss = 0;
+
+    for(size_t start=0; start<data.size(); start+=batch){
+      size_t n = std::min(batch, data.size() - start);
+      std::fill(lossSum.begin(), lossSum.end(), 0.0);
+      parallelFor(n, threads, [&](size_t b, size_t e, int tid){
+        float* g = grads[tid].data();
+        uint8_t* tch = touched[tid].data();
+        double l = 0;
+        for(size_t i=b; i<e; i++) l += backward(P.data(), g, tch, data[start + i]);
+        lossSum[tid] = l;
+      });
+
+      // 歸約：輸出層與偏置全加，輸入層只加碰到的列，順手把執行緒的緩衝歸零
+      std::fill(G.begin(), G.end(), 0.0f);
+      for(int t=0; t<threads; t++){
+        float* g = grads[t].data();
+        for(size_t i=FT_BIAS; i<SIZE; i++){ G[i] += g[i]; g[i] = 0.0f; }
+        for(int f=0; f<NNUE_INPUTS; f++){
+          if(!touched[t][f]) continue;
+          touched[t][f] = 0;
+          float* row = g + FT + (size_t)f * H;
+          float* dst = G.data() + FT + (size_t)f * H;
+          for(int i=0; i<H; i++){ dst[i] += row[i]; row[i] = 0.0f; }
+        }
+        trainLoss += lossSum[t];
+      }
+
+      step++;
+      float inv = 1.0f / n;
+      float c1 = 1.0f - std::pow(beta1, (float)step), c2 = 1.0f - std::pow(beta2, (float)step);
+      for(size_t i=0; i<SIZE; i++){
+        float g = G[i] * inv;
+        if(adam){
+          M[i] = beta1 * M[i] + (1.0f - beta1) * g;
+          V[i] = beta2 * V[i] + (1.0f - beta2) * g * g;
+          P[i] -= lr * (M[i] / c1) / (std::sqrt(V[i] / c2) + eps);
+        }else{
+          P[i] -= lr * g;
+        }
+      }
+      // 量化後要放得進 int16
+      for(size_t i=OUT; i<OUT_BIAS; i++) P[i] = std::max(-32767.0f / NNUE_QB, std::min(32767.0f / NNUE_QB, P[i]));
+    }
+
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    double vFloat = valLoss(false);
+    double vQuant = valLoss(true);
+    net->save(out);
+    std::cout << "epoch " << ep
+              << " train_loss=" << std::fixed << std::setprecision(6) << trainLoss / data.size()
+              << " val_loss=" << vFloat
+              << " val_loss_q=" << vQuant
+              << " pos/s=" << (uint64_t)(data.size() / std::max(sec, 1e-9))
+              << " time=" << std::setprecision(1) << sec << "s\n";
+    std::cout.flush();
+  }
+
+  std::cout << "Training done. Saved " << out << "\n";
+  return 0;
+}
+
+// =========================
+// 批次評估：Texel 調參、安靜局面過濾、資料集統計
+// =========================
+// 局面先用 Engine::traceEval 攤成線性項目（只做一次），之後任何一組參數都能用 batcheval.hpp 的
+// AVX2 gather 核心整批重算；沒有 AVX2 的 CPU 執行時自動退回純量版。
+
+static void buildBatch(const Engine& e, const std::vector<PackedSample>& data, EvalBatch& batch,
+                       std::vector<int>* phases = nullptr){
+  EvalTrace tr(e.w);
+  BatchEntry be;
+  Position pos;
+  batch.clear();
+  if(phases) phases->clear();
+  for(const PackedSample& s : data){
+    pos.setBoard(unpackBoard(s), s.whiteToMove);
+    e.traceEval(pos, tr, be);
+    batch.push(be);
+    if(phases) phases->push_back(std::min(pos.phase, PHASE_MAX));
+  }
+  batch.finish();
+}
+
+static std::vector<float> flattenParams(const Weights& w){
+  std::vector<double> x = ParamView::flatten(w);
+  return std::vector<float>(x.begin(), x.end());
+}
+
+// 整批評估（白方視角），依組切給各執行緒；out 長度 = blocks()*8
+static void batchEvaluate(const EvalBatch& batch, const std::vector<float>& w, std::vector<float>& out,
+                          int threads, BatchKernel kernel = BatchKernel::Auto){
+  out.resize(batch.blocks() * EvalBatch::LANES);
+  parallelFor(batch.blocks(), threads, [&](size_t b, size_t e, int){
+    evalBatch(batch, w.data(), out.data(), b, e, kernel);
+  });
+}
+
+// Texel：勝率 = 1 / (1 + 10^(-K * score / 400))
+static double texelSigmoid(double score, double K){
+  return 1.0 / (1.0 + std::pow(10.0, -K * score / 400.0));
+}
+
+static double texelError(const std::vector<float>& scores, const std::vector<PackedSample>& data, double K){
+  double sum = 0;
+  for(size_t i=0; i<data.size(); i++){
+    double d = texelSigmoid(scores[i], K) - data[i].result;
+    sum += d * d;
+  }
+  return sum / data.size();
+}
+
+// 固定分數找最合適的 K（黃金分割，誤差對 K 是單峰的）
+static double fitK(const std::vector<float>& scores, const std::vector<PackedSample>& data){
+  double lo = 0.1, hi = 3.0;
+  const double g = (std::sqrt(5.0) - 1) / 2;
+  for(int it=0; it<40; it++){
+    double a = hi - g * (hi - lo), b = lo + g * (hi - lo);
+    if(texelError(scores, data, a) < texelError(scores, data, b)) hi = b;
+    else lo = a;
+  }
+  return (lo + hi) / 2;
+}
+
+static bool loadDatasetOrFail(const std::string& path, std::vector<PackedSample>& data){
+  size_t skipped = 0;
+  if(!loadDataset(path, data, skipped)){
+    std::cerr << "Cannot open dataset " << path << "\n";
+    return false;
+  }
+  if(data.empty()){
+    std::cerr << "Dataset " << path << " has no usable positions\n";
+    return false;
+  }
+  std::cout << "dataset=" << path << " positions=" << data.size() << " skipped=" << skipped << "\n";
+  return true;
+}
+
+// 用法：trainer texel <dataset> [iterations] [threads] [out weights] [lr]
+// 從 weights.txt 出發，全批次 Adam 最小化 Texel 誤差；結果照 ParamView 的夾限取整後另存，不覆蓋 weights.txt
+static int runTexel(int argc, char** argv){
+  if(argc < 3){
+    std::cerr << "usage: trainer texel <dataset> [iterations] [threads] [out weights] [lr]\n";
+    return 1;
+  }
+  int iterations  = argc >= 4 ? std::max(1, std::atoi(argv[3])) : 500;
+  int threads     = argc >= 5 ? std::max(1, std::atoi(argv[4])) : (int)std::max(1u, std::thread::hardware_concurrency());
+  std::string out = argc >= 6 ? argv[5] : "weights_texel.txt";
+  double lr       = argc >= 7 ? std::atof(argv[6]) : 0.5;
+
+  std::vector<PackedSample> data;
+  if(!loadDatasetOrFail(argv[2], data)) return 1;
+
+  Weights base = Weights::defaultWeights();
+  base.load("weights.txt");
+  Engine e;
+  e.setWeights(base);
+
+  auto t0 = std::chrono::steady_clock::now();
+  EvalBatch batch;
+  buildBatch(e, data, batch);
+  double buildSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+  std::vector<float> w = flattenParams(base);
+  std::vector<double> lo, hi;
+  base.forEachParam([&](const char*, double*, int count, const ParamBounds& b){
+    for(int i=0;i<count;i++){
+      lo.push_back(b.lo(i));
+      hi.push_back(b.hi(i));
+    }
+  });
+
+  std::vector<float> scores;
+  batchEvaluate(batch, w, scores, threads);
+  double K = fitK(scores, data);
+
+  std::cout << "Texel tuning start\n";
+  std::cout << "params=" << w.size() << " iterations=" << iterations << " threads=" << threads
+            << " lr=" << lr << " kernel=" << kernelName(BatchKernel::Auto) << " out=" << out << "\n";
+  std::cout << "batch build " << std::fixed << std::setprecision(2) << buildSec << "s ("
+            << batch.bytes() / (1024*1024) << " MB), K=" << std::setprecision(4) << K
+            << " error=" << std::setprecision(6) << texelError(scores, data, K) << "\n";
+
+  const size_t n = w.size();
+  std::vector<std::vector<double>> grads(threads, std::vector<double>(n));
+  std::vector<double> M(n), V(n);
+  const double beta1 = 0.9, beta2 = 0.999, eps = 1e-8;
+  const double dK = K * std::log(10.0) / 400.0;
+
+  auto tLoop = std::chrono::steady_clock::now();
+  for(int it=1; it<=iterations; it++){
+    batchEvaluate(batch, w, scores, threads);
+
+    // d誤差/dw_i = Σ 2(σ-r) σ(1-σ) * dK * scale/64 * coef_i
+    parallelFor(batch.blocks(), threads, [&](size_t b0, size_t b1, int tid){
+      std::vector<double>& g = grads[tid];
+      for(size_t b=b0; b<b1; b++){
+        const size_t base = (size_t)batch.blockOffset[b] * EvalBatch::LANES;
+        for(int lane=0; lane<EvalBatch::LANES; lane++){
+          size_t i = b * EvalBatch::LANES + lane;
+          if(i >= data.size() || batch.fixedMask[i]) continue;
+          double sg = texelSigmoid(scores[i], K);
+          double scale = scores[i] > 0 ? batch.scaleW[i] : batch.scaleB[i];
+          double d = 2.0 * (sg - data[i].result) * sg * (1.0 - sg) * dK * scale / 64.0;
+          for(uint32_t k=0; k<batch.blockTerms[b]; k++){
+            size_t j = base + (size_t)k * EvalBatch::LANES + lane;
+            g[batch.idx[j]] += d * batch.coef[j];
+          }
+        }
+      }
+    });
+
+    for(size_t j=0; j<n; j++){
+      double g = 0;
+      for(int t=0; t<threads; t++){ g += grads[t][j]; grads[t][j] = 0; }
+      g /= data.size();
+      M[j] = beta1 * M[j] + (1 - beta1) * g;
+      V[j] = beta2 * V[j] + (1 - beta2) * g * g;
+      double step = lr * (M[j] / (1 - std::pow(beta1, it))) / (std::sqrt(V[j] / (1 - std::pow(beta2, it))) + eps);
+      w[j] = (float)std::min(hi[j], std::max(lo[j], w[j] - step));
+    }
+
+    if(it % 10 == 0 || it == 1 || it == iterations){
+      double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - tLoop).count();
+      std::cout << "iter " << it << " error=" << std::fixed << std::setprecision(6) << texelError(scores, data, K)
+                << " pos/s=" << (uint64_t)(double(data.size()) * it / std::max(sec, 1e-9)) << "\n";
+      std::cout.flush();
+    }
+  }
+
+  Weights tuned = ParamView::unflatten(std::vector<double>(w.begin(), w.end()), base);
+  tuned.save(out);
+  batchEvaluate(batch, flattenParams(tuned), scores, threads);
+  std::cout << "Texel done. rounded error=" << std::fixed << std::setprecision(6) << texelError(scores, data, K)
+            << " saved " << out << "\n";
+  return 0;
+}
+
+// 用法：trainer filter <in> <out> [margin]
+// 留下安靜局面：不被將軍，且 qsearch 與靜態評估差不到 margin（有吃子沒解決的局面 Texel / NNUE 學不到東西）
+static int runFilter(int argc, char** argv){
+  if(argc < 4){
+    std::cerr << "usage: trainer filter <in> <out> [margin]\n";
+    return 1;
+  }
+  int margin = argc >= 5 ? std::atoi(argv[4]) : 30;
+  std::ifstream in(argv[2]);
+  std::ofstream out(argv[3]);
+  if(!in || !out){
+    std::cerr << "Cannot open " << (!in ? argv[2] : argv[3]) << "\n";
+    return 1;
+  }
+
+  Weights base = Weights::defaultWeights();
+  base.load("weights.txt");
+  Engine e;
+  e.setWeights(base);
+  const std::vector<float> w = flattenParams(base);
+  const int threads = (int)std::max(1u, std::thread::hardware_concurrency());
+
+  size_t total = 0, kept = 0, inCheck = 0, noisy = 0, bad = 0;
+  const size_t CHUNK = 1 << 16;
+  std::vector<std::string> lines;
+  std::vector<PackedSample> samples;
+  EvalBatch batch;
+  std::vector<float> scores;
+  auto t0 = std::chrono::steady_clock::now();
+
+  auto processChunk = [&]{
+    buildBatch(e, samples, batch);
+    batchEvaluate(batch, w, scores, threads);
+    Position pos;
+    for(size_t i=0; i<samples.size(); i++){
+      pos.setBoard(unpackBoard(samples[i]), samples[i].whiteToMove);
+      if(pos.isInCheck(pos.whiteToMove)){ inCheck++; continue; }
+      int staticEval = (int)std::lround(scores[i]) * (pos.whiteToMove ? 1 : -1);
+      int qs = e.alphabeta(pos, 0, -Engine::INF, Engine::INF);
+      if(std::abs(qs - staticEval) > margin){ noisy++; continue; }
+      out << lines[i] << "\n";
+      kept++;
+    }
+    lines.clear();
+    samples.clear();
+  };
+
+  std::string line;
+  while(std::getline(in, line)){
+    if(line.empty() || line[0] == '#') continue;
+    total++;
+    PackedSample s;
+    if(!parseSample(line, s)){ bad++; continue; }
+    lines.push_back(line);
+    samples.push_back(s);
+    if(samples.size() == CHUNK) processChunk();
+  }
+  if(!samples.empty()) processChunk();
+
+  double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  std::cout << "filter: total=" << total << " kept=" << kept << " in_check=" << inCheck
+            << " noisy=" << noisy << " unparsed=" << bad << " margin=" << margin
+            << " pos/s=" << (uint64_t)(total / std::max(sec, 1e-9)) << "\n";
+  return 0;
+}
+
+// 用法：trainer stats <dataset>
+static int runStats(int argc, char** argv){
+  if(argc < 3){
+    std::cerr << "usage: trainer stats <dataset>\n";
+    return 1;
+  }
+  std::vector<PackedSample> data;
+  if(!loadDatasetOrFail(argv[2], data)) return 1;
+
+  Weights base = Weights::defaultWeights();
+  base.load("weights.txt");
+  Engine e;
+  e.setWeights(base);
+  EvalBatch batch;
+  std::vector<int> phases;
+  buildBatch(e, data, batch, &phases);
+  std::vector<float> scores;
+  batchEvaluate(batch, flattenParams(base), scores, (int)std::max(1u, std::thread::hardware_concurrency()));
+
+  size_t wins = 0, draws = 0, losses = 0, whiteToMove = 0, pieces = 0;
+  size_t phaseHist[7] = {};
+  double sum = 0, sumSq = 0;
+  const int BUCKETS = 11;                   // -500 以下、每 100cp 一格、+500 以上
+  size_t bucketN[BUCKETS] = {};
+  double bucketR[BUCKETS] = {};
+  for(size_t i=0; i<data.size(); i++){
+    const PackedSample& s = data[i];
+    if(s.result > 0.75f) wins++;
+    else if(s.result < 0.25f) losses++;
+    else draws++;
+    whiteToMove += s.whiteToMove;
+    pieces += s.count;
+    phaseHist[std::min(phases[i] / 4, 6)]++;
+    double sc = scores[i];
+    sum += sc;
+    sumSq += sc * sc;
+    int bk = sc < -500 ? 0 : sc >= 500 ? BUCKETS-1 : (int)((sc + 500) / 100);
+    bucketN[bk]++;
+    bucketR[bk] += s.result;
+  }
+  const double N = (double)data.size();
+  double mean = sum / N;
+  double K = fitK(scores, data);
+
+  std::cout << std::fixed << std::setprecision(1);
+  std::cout << "results   : 1-0 " << 100.0*wins/N << "%  1/2 " << 100.0*draws/N << "%  0-1 " << 100.0*losses/N << "%\n";
+  std::cout << "side      : white to move " << 100.0*whiteToMove/N << "%\n";
+  std::cout << "pieces    : " << std::setprecision(2) << pieces/N << " per position\n";
+  std::cout << "phase     :";
+  for(int b=0; b<7; b++) std::cout << " " << b*4 << (b<6 ? "-" + std::to_string(b*4+3) : "+") << ":" << phaseHist[b];
+  std::cout << "\n";
+  std::cout << "eval      : mean " << std::setprecision(1) << mean << " cp, stdev "
+            << std::sqrt(std::max(0.0, sumSq/N - mean*mean)) << " cp (kernel " << kernelName(BatchKernel::Auto) << ")\n";
+  std::cout << "texel     : K=" << std::setprecision(4) << K << " error=" << std::setprecision(6) << texelError(scores, data, K) << "\n";
+  std::cout << "eval bucket -> mean result (white)\n";
+  for(int b=0; b<BUCKETS; b++){
+    if(!bucketN[b]) continue;
+    std::string label = b==0 ? "   < -500" : b==BUCKETS-1 ? "  >= +500" : "";
+    if(label.empty()){
+      std::ostringstream ls;
+      ls << std::setw(5) << (b-1)*100-500 << "..";
+      label = ls.str();
+      label = std::string(9 - std::min<size_t>(9, label.size()), ' ') + label;
+    }
+    std::cout << label << "  n=" << std::setw(8) << bucketN[b]
+              << "  result=" << std::setprecision(3) << bucketR[b]/bucketN[b] << "\n";
+  }
+  return 0;
+}
+
+// 用法：trainer batchbench <dataset> [repeat]
+// 單執行緒比較：逐局面 Engine::eval（不經快取）vs 批次純量 vs 批次 AVX2，並檢查批次結果與 eval 的差距
+static int runBatchBench(int argc, char** argv){
+  if(argc < 3){
+    std::cerr << "usage: trainer batchbench <dataset> [repeat]\n";
+    return 1;
+  }
+  int repeat = argc >= 4 ? std::max(1, std::atoi(argv[3])) : 5;
+  std::vector<PackedSample> data;
+  if(!loadDatasetOrFail(argv[2], data)) return 1;
 
+  Weights base = Weights::defaultWeights();
+  base.load("weights.txt");
+  Engine e;
+  e.setWeights(base);
+
+  std::vector<Position> positions(data.size());
+  for(size_t i=0; i<data.size(); i++){
+    positions[i].setBoard(unpackBoard(data[i]), data[i].whiteToMove);
+    e.attachPsq(positions[i]);
+  }
+
+  using Clock = std::chrono::steady_clock;
+  auto rate = [&](Clock::time_point t0){
+    double sec = std::chrono::duration<double>(Clock::now() - t0).count();
+    return (uint64_t)(double(data.size()) * repeat / std::max(sec, 1e-9));
+  };
+
+  std::vector<int> ref(data.size());
+  auto t0 = Clock::now();
+  for(int r=0; r<repeat; r++)
+    for(size_t i=0; i<positions.size(); i++) ref[i] = e.eval(positions[i]);
+  uint64_t perPos = rate(t0);
+
+  t0 = Clock::now();
+  EvalBatch batch;
+  buildBatch(e, data, batch);
+  double buildSec = std::chrono::duration<double>(Clock::now() - t0).count();
+
+  const std::vector<float> w = flattenParams(base);
+  std::vector<float> scores;
+  t0 = Clock::now();
+  for(int r=0; r<repeat; r++) batchEvaluate(batch, w, scores, 1, BatchKernel::Scalar);
+  uint64_t scalar = rate(t0);
+
+  bool hasAvx2 = resolveKernel(BatchKernel::Avx2) == BatchKernel::Avx2;
+  uint64_t avx2 = 0;
+  std::vector<float> scoresAvx;
+  if(hasAvx2){
+    t0 = Clock::now();
+    for(int r=0; r<repeat; r++) batchEvaluate(batch, w, scoresAvx, 1, BatchKernel::Avx2);
+    avx2 = rate(t0);
+  }
+
+  double diffSum = 0, diffMax = 0, simdMax = 0;
+  for(size_t i=0; i<data.size(); i++){
+    double d = std::abs(scores[i] - ref[i]);
+    diffSum += d;
+    diffMax = std::max(diffMax, d);
+    if(hasAvx2) simdMax = std::max(simdMax, (double)std::abs(scores[i] - scoresAvx[i]));
+  }
+
+  std::cout << "\n=== BATCHBENCH DONE ===\n";
+  std::cout << "Positions : " << data.size() << " x " << repeat << "\n";
+  std::cout << "Build     : " << std::fixed << std::setprecision(3) << buildSec << " sec ("
+            << batch.bytes() / 1024 << " KB, once per dataset)\n";
+  std::cout << "per-pos   : " << perPos << " pos/s\n";
+  std::cout << "scalar    : " << scalar << " pos/s (" << std::setprecision(1) << double(scalar)/perPos << "x)\n";
+  if(hasAvx2) std::cout << "avx2      : " << avx2 << " pos/s (" << double(avx2)/perPos << "x)\n";
+  else        std::cout << "avx2      : not supported on this CPU\n";
+  std::cout << "vs eval   : mean |diff| " << std::setprecision(2) << diffSum / data.size()
+            << " cp, max " << diffMax << " cp";
+  if(hasAvx2) std::cout << "; scalar vs avx2 max " << simdMax << " cp";
+  std::cout << "\n";
+  return 0;
+}
+
+// 用法：trainer lazy <dataset> [margin_psq] [margin_hash]
+// 1) 各段部分分數和完整評估的差距分布，建議的 margin 取 99.5 百分位
+// 2) 用給定的 margin 跑 qsearch，和關掉 lazy 的結果對照（出口比例、分數差、速度）
+static int runLazyMargins(int argc, char** argv){
+  if(argc < 3){
+    std::cerr << "usage: trainer lazy <dataset> [margin_psq] [margin_hash]\n";
+    return 1;
+  }
+  std::vector<PackedSample> data;
+  if(!loadDatasetOrFail(argv[2], data)) return 1;
+
+  Weights base = Weights::defaultWeights();
+  base.load("weights.txt");
+  Engine e;
+  e.setWeights(base);
+  if(argc >= 4) e.lazyMargin[0] = std::atoi(argv[3]);
+  if(argc >= 5) e.lazyMargin[1] = std::atoi(argv[4]);
+  Engine hashOnly = e;
+  hashOnly.evalTerms = TERM_ALL & ~TERM_ACTIVITY;
+
+  // 第 1 段只在 evalLazy 允許提早結束的局面（雙方有兵、phase > 2）才算
+  std::vector<int> diff[2];
+  Position pos;
+  for(const PackedSample& s : data){
+    pos.setBoard(unpackBoard(s), s.whiteToMove);
+    int full = e.eval(pos);
+    if(pos.pieceCount[WP] && pos.pieceCount[BP] && pos.phase > 2) diff[0].push_back(std::abs(full - e.psqEval(pos)));
+    diff[1].push_back(std::abs(full - hashOnly.eval(pos)));
+  }
+
+  const char* names[2] = { "psq ", "hash" };
+  std::cout << "tier  positions    p50    p90    p99  p99.9    max  >margin  suggest\n";
+  for(int k=0; k<2; k++){
+    std::vector<int>& d = diff[k];
+    if(d.empty()) continue;
+    std::sort(d.begin(), d.end());
+    auto pct = [&](double q){ return d[std::min(d.size()-1, (size_t)(q * d.size()))]; };
+    size_t over = d.end() - std::upper_bound(d.begin(), d.end(), e.lazyMargin[k]);
+    int suggest = (pct(0.995) + 9) / 10 * 10;
+    std::cout << names[k] << "  " << std::setw(9) << d.size()
+              << std::setw(7) << pct(0.5) << std::setw(7) << pct(0.9) << std::setw(7) << pct(0.99)
+              << std::setw(7) << pct(0.999) << std::setw(7) << d.back()
+              << std::setw(8) << std::fixed << std::setprecision(2) << 100.0 * over / d.size() << "%"
+              << std::setw(9) << suggest << "\n";
+  }
+
+  // qsearch 對照：同一批局面，lazy 開 / 關
+  auto runQs = [&](Engine& eng, std::vector<int>& out, uint64_t exits[3]){
+    eng.clearHash();
+    eng.alphabeta(pos, 0, -Engine::INF, Engine::INF);   // 建好 worker
+    SearchThread& t = *(*eng.workers)[0];
+    std::fill(t.lazyExits, t.lazyExits + 3, 0);
+    auto t0 = std::chrono::steady_clock::now();
+    for(const PackedSample& s : data){
+      pos.setBoard(unpackBoard(s), s.whiteToMove);
+      out.push_back(pos.isInCheck(pos.whiteToMove) ? 0 : eng.alphabeta(pos, 0, -Engine::INF, Engine::INF));
+    }
+    std::copy(t.lazyExits, t.lazyExits + 3, exits);
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  };
+  Engine exact = e;
+  exact.lazyMargin[0] = exact.lazyMargin[1] = Engine::INF / 2;
+  std::vector<int> qsLazy, qsExact;
+  uint64_t exLazy[3], exExact[3];
+  double secLazy = runQs(e, qsLazy, exLazy);
+  double secExact = runQs(exact, qsExact, exExact);
+
+  size_t changed = 0;
+  long long sumDiff = 0;
+  int maxDiff = 0;
+  for(size_t i=0; i<qsLazy.size(); i++){
+    int d = std::abs(qsLazy[i] - qsExact[i]);
+    changed += d != 0;
+    sumDiff += d;
+    maxDiff = std::max(maxDiff, d);
+  }
+  uint64_t evals = std::max<uint64_t>(exLazy[0] + exLazy[1] + exLazy[2], 1);
+  std::cout << "qsearch margins " << e.lazyMargin[0] << "/" << e.lazyMargin[1]
+            << ": exits psq " << std::setprecision(1) << 100.0 * exLazy[LAZY_PSQ] / evals
+            << "% hash " << 100.0 * exLazy[LAZY_HASH] / evals << "% full " << 100.0 * exLazy[LAZY_FULL] / evals << "%\n";
+  std::cout << "vs exact       : changed " << std::setprecision(2) << 100.0 * changed / qsLazy.size()
+            << "%, mean |diff| " << (double)sumDiff / qsLazy.size() << " cp, max " << maxDiff
+            << " cp; time " << std::setprecision(3) << secLazy << "s vs " << secExact << "s\n";
+  return 0;
+}
+
+// =========================
+// Parsetest：資料集結果欄位的解析（ctest 跑這個）
+// =========================
+static int runParseTest(){
+  const std::string fen = "rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq -";
+  struct Case { std::string line; bool ok; float result; };
+  const Case cases[] = {
+    {fen + " c9 \"1/2-1/2\"; hmvc 0;", true, 0.5f},
+    {fen + " c9 \"1-0\"; acd 1;", true, 1.0f},
+    {fen + " c9 \"0-1\"; fmvn 1;", true, 0.0f},
+    {fen + " hmvc 0; fmvn 1; c9 \"1-0\";", true, 1.0f},
+    {fen + " 0 1 [0.5]", true, 0.5f},
+    {fen + " 0 1 [1.0];", true, 1.0f},
+    {fen + " | 0", true, 0.0f},
+    {fen + " 0 1 1-0", true, 1.0f},
+    {fen + " 0.25", true, 0.25f},
+    {fen + " hmvc 0;", false, 0},
+    {fen + " acd 1; fmvn 1;", false, 0},
+  };
+  int failed = 0;
+  for(const Case& c : cases){
+    PackedSample s;
+    bool ok = parseSample(c.line, s);
+    if(ok != c.ok || (ok && s.result != c.result)){
+      std::cerr << "FAIL: " << c.line << " -> " << (ok ? std::to_string(s.result) : std::string("rejected")) << "\n";
+      failed++;
+    }
+  }
+  std::cout << "parsetest: " << (sizeof(cases)/sizeof(cases[0]) - failed) << "/" << sizeof(cases)/sizeof(cases[0]) << " passed\n";
+  return failed ? 1 : 0;
+}
+
+// =========================
 // Main
 // =========================
 int main(int argc, char** argv){
 
+  if(argc >= 2 && std::string(argv[1]) == "nnue") {
+    return runNnueTraining(argc, argv);
+  }
+  if(argc >= 2 && std::string(argv[1]) == "texel") {
+    return runTexel(argc, argv);
+  }
+  if(argc >= 2 && std::string(argv[1]) == "filter") {
+    return runFilter(argc, argv);
+  }
+  if(argc >= 2 && std::string(argv[1]) == "stats") {
+    return runStats(argc, argv);
+  }
+  if(argc >= 2 && std::string(argv[1]) == "batchbench") {
+    return runBatchBench(argc, argv);
+  }
+  if(argc >= 2 && std::string(argv[1]) == "lazy") {
+    return runLazyMargins(argc, argv);
+  }
+  if(argc >= 2 && std::string(argv[1]) == "parsetest") {
+    return runParseTest();
+  }
+
   if(argc >= 2 && std::string(argv[1]) == "export") {
     std::vector<double> x;
     if(!loadCheckpoint("checkpoint.bin", x)){
@@ -183,23 +1057,26 @@ int main(int argc, char** argv){
 
     std::cout << "[OK] exported weights_ckpt.txt from checkpoint.bin\n";
     std::cout << "material[0]=" << cur.material[0]
-              << " pawnPST0=" << cur.pstPawn[0]
-              << " knightPST0=" << cur.pstKnight[0] << "\n";
+              << " pawnPST0=" << cur.pst[MG][0][0]
+              << " knightPST0=" << cur.pst[MG][1][0] << "\n";
     return 0;
   }
   // 用法：
-  // trainer.exe iterations games depth verify_games
+  // trainer.exe iterations games depth verify_games [nodes]
   // 例：trainer.exe 12000 25 2 200
+  //     trainer.exe 12000 25 0 200 5000   （每步固定 5000 節點）
 
   int iterations    = 20000;
   int gamesPerEval  = 200;
   int depth         = 3;
   int verifyGames   = 400;   // ← 預設值（沒給參數時用）
+  uint64_t nodes    = 0;     // >0 時改用固定節點數（此時忽略 depth）
 
   if(argc >= 2) iterations   = std::atoi(argv[1]);
   if(argc >= 3) gamesPerEval = std::atoi(argv[2]);
   if(argc >= 4) depth        = std::atoi(argv[3]);
   if(argc >= 5) verifyGames  = std::atoi(argv[4]);
+  if(argc >= 6) nodes        = std::strtoull(argv[5], nullptr, 10);
 
   // 長跑額外參數（可直接改這裡）
   const int PRINT_EVERY       = 20;   // 每 20 iter 印一次
@@ -244,6 +1121,7 @@ int main(int argc, char** argv){
           << " games="<<gamesPerEval
           << " depth="<<depth
           << " verifyGames="<<verifyGames
+          << " nodes="<<nodes
           << "\n";
 
   std::cout << "params: a="<<a<<" c="<<c<<" A="<<A<<" alpha="<<alpha<<" gamma="<<gamma<<"\n";
@@ -268,8 +1146,8 @@ int main(int argc, char** argv){
     Weights wMinus = ParamView::unflatten(xMinus, base);
 
     // 差分：兩邊都算（比較穩）
-    double sPlus  = matchScore(wPlus,  wMinus, gamesPerEval, depth, rng);
-    double sMinus = matchScore(wMinus, wPlus,  gamesPerEval, depth, rng);
+    double sPlus  = matchScore(wPlus,  wMinus, gamesPerEval, depth, nodes, rng);
+    double sMinus = matchScore(wMinus, wPlus,  gamesPerEval, depth, nodes, rng);
     double yDiff = sPlus - sMinus;
 
     for(size_t i=0;i<x.size();i++){
@@ -278,7 +1156,7 @@ int main(int argc, char** argv){
     }
 
     Weights current = ParamView::unflatten(x, base);
-    double scoreVsBase = matchScore(current, base, gamesPerEval, depth, rng);
+    double scoreVsBase = matchScore(current, base, gamesPerEval, depth, nodes, rng);
 
     if((k+1) % PRINT_EVERY == 0 || k==0){
       std::cout << "iter " << (k+1)
@@ -299,7 +1177,7 @@ int main(int argc, char** argv){
 
     // best：先 verify 再存，避免噪音亂存
     if(scoreVsBase > bestScore){
-      double verify = matchScore(current, base, verifyGames, depth, rng);
+      double verify = matchScore(current, base, verifyGames, depth, nodes, rng);
       if(verify > bestScore){
         bestScore = verify;
         bestX = x;
@@ -307,8 +1185,8 @@ int main(int argc, char** argv){
         Weights bestW = ParamView::unflatten(bestX, base);
         bestW.save("weights.txt");
 
-        auto [pMn,pMx] = minmaxArr(bestW.pstPawn, 64);
-        auto [nMn,nMx] = minmaxArr(bestW.pstKnight, 64);
+        auto [pMn,pMx] = minmaxArr(bestW.pst[MG][0], 64);
+        auto [nMn,nMx] = minmaxArr(bestW.pst[MG][1], 64);
 
         std::cout << "  >> VERIFIED new best saved (bestScore="<<std::fixed<<std::setprecision(3)<<bestScore<<")\n";
         std::cout << "     material=["<<bestW.material[0]<<","<<bestW.material[1]<<","<<bestW.material[2]
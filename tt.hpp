@@ -0,0 +1,212 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// =========================
+// Transposition table
+// =========================
+// 兩格一組（cluster）：同局面就地更新，否則換掉較淺的那格。多執行緒（YBWC）同時讀寫不加鎖：
+// key 欄位存 key^data，讀到被撕裂的 entry 時兩者對不起來，視為 miss。
+enum TTBound : uint8_t {
+    BOUND_NONE = 0,
+    BOUND_UPPER,    // 分數 <= score（fail-low）
+    BOUND_LOWER,    // 分數 >= score（fail-high）
+    BOUND_EXACT
+};
+
+struct TTData {
+    uint16_t move=0;   // from | to<<6 | promo<<12，0 = 無
+    int32_t score=0;
+    int8_t depth=0;
+    TTBound bound=BOUND_NONE;
+};
+
+struct TranspositionTable {
+    struct Entry {
+        uint64_t check=0;   // key ^ data
+        uint64_t data=0;    // move16 | score32 | depth8 | bound8
+    };
+
+    std::vector<Entry> table;
+    uint64_t mask=0;
+
+    // 以 MB 為單位，取不超過的 2 的冪個 entry
+    void resize(size_t mb){
+        size_t n = 2;
+        while(n * 2 * sizeof(Entry) <= mb * 1024 * 1024) n *= 2;
+        table.assign(n, Entry{});
+        mask = n - 1;
+    }
+
+    void clear(){ std::fill(table.begin(), table.end(), Entry{}); }
+
+    static uint64_t pack(const TTData& d){
+        return  (uint64_t)d.move
+              | ((uint64_t)(uint32_t)d.score << 16)
+              | ((uint64_t)(uint8_t)d.depth << 48)
+              | ((uint64_t)d.bound << 56);
+    }
+    static TTData unpack(uint64_t v){
+        TTData d;
+        d.move  = (uint16_t)(v & 0xFFFF);
+        d.score = (int32_t)(uint32_t)(v >> 16);
+        d.depth = (int8_t)(uint8_t)(v >> 48);
+        d.bound = (TTBound)(uint8_t)(v >> 56);
+        return d;
+    }
+
+    Entry* cluster(uint64_t key){ return &table[key & mask & ~1ULL]; }
+    const Entry* cluster(uint64_t key) const{ return &table[key & mask & ~1ULL]; }
+
+    bool probe(uint64_t key, TTData& out) const{
+        const Entry* c = cluster(key);
+        for(int i=0;i<2;i++){
+            uint64_t data = c[i].data;
+            if((c[i].check ^ data) != key || data == 0) continue;
+            out = unpack(data);
+            return true;
+        }
+        return false;
+    }
+
+    // 同一局面時保留較深的結果（除非新的是 exact）；不同局面換掉 cluster 裡較淺的一格
+    void store(uint64_t key, const TTData& d){
+        Entry* c = cluster(key);
+        Entry* victim = nullptr;
+        for(int i=0;i<2 && !victim;i++){
+            uint64_t old = c[i].data;
+            if((c[i].check ^ old) == key && old != 0){
+                if(d.bound != BOUND_EXACT && d.depth < unpack(old).depth) return;
+                victim = &c[i];
+            }
+        }
+        if(!victim) victim = unpack(c[0].data).depth <= unpack(c[1].data).depth ? &c[0] : &c[1];
+
+        uint64_t data = pack(d);
+        victim->data = data;
+        victim->check = key ^ data;
+    }
+
+    // 每千格中有幾格被用到，UCI hashfull
+    int hashfull() const{
+        size_t n = std::min<size_t>(1000, table.size()), used = 0;
+        for(size_t i=0;i<n;i++) if(table[i].data) used++;
+        return (int)(used * 1000 / std::max<size_t>(n, 1));
+    }
+};
+
+// =========================
+// Eval cache
+// =========================
+// 直接對映、每執行緒一份（不需要處理競爭）。一格 64 bits：key 的高 48 bits | int16 分數，
+// 索引用低位元，所以整把 key 都有比對到。權重換掉之後要 clear()。
+struct EvalCache {
+    static constexpr size_t DEFAULT_ENTRIES = 1 << 16;   // 512 KB
+
+    std::vector<uint64_t> table;
+    uint64_t mask=0;
+    uint64_t probes=0, hits=0;
+
+    explicit EvalCache(size_t entries = DEFAULT_ENTRIES){ resize(entries); }
+
+    // entries 取 2 的冪，且至少 2^16（低 16 bits 要由索引涵蓋）
+    void resize(size_t entries){
+        size_t n = DEFAULT_ENTRIES;
+        while(n < entries) n *= 2;
+        table.assign(n, 0);
+        mask = n - 1;
+    }
+
+    void clear(){ std::fill(table.begin(), table.end(), 0); }
+    void resetStats(){ probes = hits = 0; }
+
+    bool probe(uint64_t key, int& score){
+        probes++;
+        uint64_t e = table[key & mask];
+        if(!e || ((e ^ key) & ~0xFFFFULL)) return false;
+        hits++;
+        score = (int16_t)(uint16_t)(e & 0xFFFF);
+        return true;
+    }
+
+    void store(uint64_t key, int score){
+        score = std::max(-32767, std::min(32767, score));
+        table[key & mask] = (key & ~0xFFFFULL) | (uint16_t)(int16_t)score;
+    }
+};
+
+// =========================
+// Pawn hash
+// =========================
+// 兵型只在兵走動或被吃時改變，同一個 pawn key 在搜尋樹裡重複非常多次。
+// 每執行緒一份、直接對映；存完整 key，查不到就整格重算覆蓋。
+struct PawnEntry {
+    uint64_t key=0;
+    int16_t score=0;            // 白方視角（通路兵 / 孤兵 / 疊兵 / 落後兵）
+    uint64_t passed[2]{};       // [0]=白, [1]=黑 的通路兵所在格
+    uint64_t attacks[2]{};      // 兵攻擊到的格
+    uint64_t attackSpan[2]{};   // 兵往前推進後可能攻擊到的格（前方相鄰兩線）
+};
+
+// 以完整 key 比對的直接對映表（pawn hash / material hash 共用）；Entry 需有 uint64_t key
+template<class Entry>
+struct KeyedTable {
+    std::vector<Entry> table;
+    uint64_t mask=0;
+    uint64_t probes=0, hits=0;
+
+    explicit KeyedTable(size_t entries){ resize(entries); }
+
+    void resize(size_t entries){
+        size_t n = 1;
+        while(n < entries) n *= 2;
+        table.assign(n, Entry{});
+        mask = n - 1;
+    }
+
+    void clear(){ std::fill(table.begin(), table.end(), Entry{}); }
+    void resetStats(){ probes = hits = 0; }
+
+    // 回傳對應的格子；found=false 時由呼叫端填內容（key 已寫好）
+    Entry* probe(uint64_t key, bool& found){
+        probes++;
+        Entry* e = &table[key & mask];
+        found = e->key == key;
+        if(found) hits++;
+        else e->key = key;
+        return e;
+    }
+};
+
+struct PawnTable : KeyedTable<PawnEntry> {
+    static constexpr size_t DEFAULT_ENTRIES = 1 << 14;
+    PawnTable() : KeyedTable(DEFAULT_ENTRIES){}
+};
+
+// =========================
+// Material hash
+// =========================
+// 以子力組成（每種棋子幾顆）為 key：不平衡修正、遊戲階段、殘局縮放與特化殘局評估都只跟組成有關，
+// 每種組成算一次就好。
+enum EndgameType : uint8_t {
+    EG_NONE = 0,
+    EG_DRAW,      // 子力不足（KK、KNK、KBK、KNNK、雙方各一輕子）
+    EG_KXK,       // 孤王對足以將殺的子力：把王趕到邊上
+    EG_KBNK       // 象馬殺王：趕到象同色的角落
+};
+
+struct MaterialEntry {
+    uint64_t key=0;
+    int16_t imbalance=0;          // 白方視角
+    uint8_t phase=0;              // 0 = 純殘局 … 24 = 開局子力全在
+    uint8_t scale[2]{64,64};      // [0]=白 / [1]=黑占優時分數乘 scale/64
+    EndgameType endgame=EG_NONE;
+    uint8_t strongSide=0;         // 特化殘局的優勢方（0=白）
+    bool bishopsOnly=false;       // 雙方都只剩一個象（加兵）：盤面上再看是不是異色象
+};
+
+struct MaterialTable : KeyedTable<MaterialEntry> {
+    static constexpr size_t DEFAULT_ENTRIES = 1 << 13;
+    MaterialTable() : KeyedTable(DEFAULT_ENTRIES){}
+};